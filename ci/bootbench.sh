@@ -0,0 +1,37 @@
+#!/bin/sh
+
+# boot time, from main() to init starting sh, at several RAM
+# sizes, from the timestamps a BENCH=1 kernel prints. the
+# string benchmarks run in between, so their time is left out.
+
+set -e
+
+cd "$(dirname "$0")"
+cd ..
+
+make clean >/dev/null
+make BENCH=1 kernel/kernel fs.img >/dev/null
+
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+
+[ $# -gt 0 ] || set -- 128M 512M 2G
+for mem in "$@"; do
+  make BENCH=1 MEM=$mem CPUS=1 qemu </dev/null >"$log" 2>&1 &
+  pid=$!
+  for i in $(seq 60); do
+    grep -q 'bench: starting sh' "$log" && break
+    sleep 1
+  done
+  pkill -P $pid qemu-system || true
+  wait $pid || true
+  awk -v mem=$mem '
+    /bench: main at/ { main = $4; kinit = $7; sb = $10 }
+    /bench: starting sh at/ { sh = $5 }
+    END {
+      if(sh == "")
+        print mem ": no boot timestamps" > "/dev/stderr"
+      else
+        printf "%s: boot %d us, kinit %d us\n", mem, sh - main - sb, kinit
+    }' "$log"
+done
@@ -2,7 +2,7 @@ from datetime import timedelta, datetime
 from argparse import ArgumentParser
 
 from suite.usertests import Xv6UserTestSuite
-from suite.custom import DUMPTESTS, DUMP2TESTS, ALLOCTEST, COWTEST, LAZYTESTS
+from suite.custom import DUMPTESTS, DUMP2TESTS, ALLOCTEST, COWTEST, LAZYTESTS, FPTEST, VECTEST, SCHEDTEST, SYSBENCH, URINGTEST
 from test import assert_eq
 from qemu import Qemu
 
@@ -16,6 +16,11 @@ SUITES = {
         ALLOCTEST,
         COWTEST,
         LAZYTESTS,
+        FPTEST,
+        VECTEST,
+        SCHEDTEST,
+        SYSBENCH,
+        URINGTEST,
     )
 }
 
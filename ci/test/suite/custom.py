@@ -265,6 +265,11 @@ COWTEST = SimpleSuite(
             timeout = timedelta(seconds = 60),
             patterns = ["file: ok"],
         ),
+        PatternTest(
+            name = "pagetable",
+            timeout = timedelta(seconds = 60),
+            patterns = ["pagetable: ok"],
+        ),
     ],
     epilogue = ["ALL COW TESTS PASSED"],
 )
@@ -289,3 +294,243 @@ LAZYTESTS = SimpleSuite(
     ],
     epilogue = ["ALL TESTS PASSED"],
 )
+
+
+FPTEST = SimpleSuite(
+    name = "fptest",
+    prologue = ["fptest starting"],
+    tests = [
+        PatternTest(
+            name = test_name,
+            timeout = timedelta(seconds = 60),
+            patterns = [
+                f"running test {test_name}",
+                f"test {test_name}: OK",
+            ],
+        ) for test_name in (
+            "fp basic",
+            "fp switch",
+            "fp fork",
+        )
+    ],
+    epilogue = ["ALL TESTS PASSED"],
+)
+
+
+# ci's qemu harts have no vectors, so vectest's probe is
+# killed and it skips the tests; make RVV=1 qemu runs them.
+VECTEST = SimpleSuite(
+    name = "vectest",
+    prologue = ["vectest starting"],
+    tests = [
+        PatternTest(
+            name = "vec probe",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "usertrap\\(\\): unexpected scause 0x2 pid=\\d+",
+                " +sepc=0x[0-9a-f]+ stval=0x[0-9a-f]+",
+                "no vector extension, skipping",
+            ],
+        ),
+    ],
+    epilogue = ["ALL TESTS PASSED"],
+)
+
+
+SCHEDTEST = SimpleSuite(
+    name = "schedtest",
+    prologue = ["schedtest starting"],
+    tests = [
+        PatternTest(
+            name = "nice fork",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test nice fork",
+                "test nice fork: OK",
+            ],
+        ),
+        PatternTest(
+            name = "nice share",
+            timeout = timedelta(seconds = 60),
+            patterns = [
+                "running test nice share",
+                "nice share: nice 0 \\d+, nice 6 \\d+",
+                "test nice share: OK",
+            ],
+        ),
+        PatternTest(
+            name = "deadline admit",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test deadline admit",
+                "test deadline admit: OK",
+            ],
+        ),
+        PatternTest(
+            name = "deadline periodic",
+            timeout = timedelta(seconds = 60),
+            patterns = [
+                "running test deadline periodic",
+                "deadline periodic: \\d+ jobs in \\d+ ticks, \\d+ missed",
+                "test deadline periodic: OK",
+            ],
+        ),
+        PatternTest(
+            name = "deadline overrun",
+            timeout = timedelta(seconds = 30),
+            patterns = [
+                "running test deadline overrun",
+                "test deadline overrun: OK",
+            ],
+        ),
+        PatternTest(
+            name = "hires sleep",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test hires sleep",
+                "hires sleep: \\d+ 1ms sleeps in \\d+ ticks",
+                "test hires sleep: OK",
+            ],
+        ),
+        PatternTest(
+            name = "many sleepers",
+            timeout = timedelta(seconds = 20),
+            patterns = [
+                "running test many sleepers",
+                "test many sleepers: OK",
+            ],
+        ),
+        PatternTest(
+            name = "affinity",
+            timeout = timedelta(seconds = 20),
+            patterns = [
+                "running test affinity",
+                "test affinity: OK",
+            ],
+        ),
+        PatternTest(
+            name = "wake latency",
+            timeout = timedelta(seconds = 20),
+            patterns = [
+                "running test wake latency",
+                "wake latency: \\d+ round trips in \\d+ ticks",
+                "test wake latency: OK",
+            ],
+        ),
+        PatternTest(
+            name = "pipe handoff",
+            timeout = timedelta(seconds = 30),
+            patterns = [
+                "running test pipe handoff",
+                "pipe handoff: \\d+ round trips in \\d+ ticks",
+                "test pipe handoff: OK",
+            ],
+        ),
+        PatternTest(
+            name = "group quota",
+            timeout = timedelta(seconds = 30),
+            patterns = [
+                "running test group quota",
+                "group quota: \\d+ ms used in \\d+ ticks, throttled \\d+ times",
+                "test group quota: OK",
+            ],
+        ),
+    ],
+    epilogue = ["ALL TESTS PASSED"],
+)
+
+
+SYSBENCH = SimpleSuite(
+    name = "sysbench",
+    prologue = ["sysbench starting"],
+    tests = [
+        PatternTest(
+            name = "fast answers",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test fast answers",
+                "test fast answers: OK",
+            ],
+        ),
+        PatternTest(
+            name = "vdso answers",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test vdso answers",
+                "test vdso answers: OK",
+            ],
+        ),
+        PatternTest(
+            name = "latency",
+            timeout = timedelta(seconds = 20),
+            patterns = [
+                "running test latency",
+                "latency: calls per tick: getpid \\d+, full path \\d+",
+                "latency: calls per tick: uptime \\d+, full path \\d+",
+                "latency: calls per tick: ugetpid \\d+, uuptime \\d+",
+                "test latency: OK",
+            ],
+        ),
+        PatternTest(
+            name = "batch answers",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test batch answers",
+                "test batch answers: OK",
+            ],
+        ),
+        PatternTest(
+            name = "batch latency",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test batch latency",
+                "batch latency: calls per tick: nice\\(0\\) \\d+, batched \\d+",
+                "test batch latency: OK",
+            ],
+        ),
+    ],
+    epilogue = ["ALL TESTS PASSED"],
+)
+
+URINGTEST = SimpleSuite(
+    name = "uringtest",
+    prologue = ["uringtest starting"],
+    tests = [
+        PatternTest(
+            name = "rings",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test rings",
+                "test rings: OK",
+            ],
+        ),
+        PatternTest(
+            name = "full ring",
+            timeout = timedelta(seconds = 10),
+            patterns = [
+                "running test full ring",
+                "test full ring: OK",
+            ],
+        ),
+        PatternTest(
+            name = "exit in flight",
+            timeout = timedelta(seconds = 20),
+            patterns = [
+                "running test exit in flight",
+                "test exit in flight: OK",
+            ],
+        ),
+        PatternTest(
+            name = "queue depth",
+            timeout = timedelta(seconds = 60),
+            patterns = [
+                "running test queue depth",
+                "queue depth: depth 1: \\d+ KB/s",
+                "queue depth: depth 4: \\d+ KB/s",
+                "queue depth: depth 16: \\d+ KB/s",
+                "test queue depth: OK",
+            ],
+        ),
+    ],
+    epilogue = ["ALL TESTS PASSED"],
+)
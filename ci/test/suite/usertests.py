@@ -39,6 +39,8 @@ QUICK_TESTS = [
     Xv6UserTest(name="forkfork", timeout=timedelta(seconds=3)),
     Xv6UserTest(name="forkforkfork", timeout=timedelta(seconds=8)),
     Xv6UserTest(name="reparent2", timeout=timedelta(seconds=15)),
+    Xv6UserTest(name="waitpid", timeout=timedelta(seconds=2)),
+    Xv6UserTest(name="spawn", timeout=timedelta(seconds=2)),
     Xv6UserTest(name="mem", timeout=timedelta(seconds=5)),
     Xv6UserTest(name="sharedfd", timeout=timedelta(seconds=36)),
     Xv6UserTest(name="fourfiles", timeout=timedelta(seconds=5)),
@@ -54,7 +56,7 @@ QUICK_TESTS = [
     Xv6UserTest(name="rmdot", timeout=timedelta(seconds=2)),
     Xv6UserTest(name="dirfile", timeout=timedelta(seconds=2)),
     Xv6UserTest(name="iref", timeout=timedelta(seconds=16)),
-    Xv6UserTest(name="forktest", timeout=timedelta(seconds=1)),
+    Xv6UserTest(name="forktest", timeout=timedelta(seconds=10)),
     Xv6UserTest(name="sbrkbasic", timeout=timedelta(seconds=3)),
     Xv6UserTest(name="sbrkmuch", timeout=timedelta(seconds=2)),
     Xv6UserTest(
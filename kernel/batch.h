@@ -0,0 +1,14 @@
+// system calls for batch() to run in one trip into the kernel.
+#define NBATCH      32   // maximum calls per batch()
+
+#define BATCH_STOP  0x1  // stop the batch if this call returns < 0
+#define BATCH_CHAIN 0x2  // pass call from's result as argument arg
+
+struct batchcall {
+  int num;           // system call number, from syscall.h
+  int flags;
+  int from;          // BATCH_CHAIN: an earlier call in the batch
+  int arg;           // BATCH_CHAIN: which of args[] to replace
+  uint64 args[6];
+  uint64 ret;        // the call's result, filled in by batch()
+};
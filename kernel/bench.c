@@ -0,0 +1,130 @@
+//
+// boot-time microbenchmark for the string.c routines, built
+// with make BENCH=1. prints bytes copied, set, compared or
+// scanned per cycle, next to a byte-at-a-time loop.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NREP 64   // calls per measurement
+
+static int sizes[] = { 16, 64, 512, PGSIZE - 64 };
+
+// the loops string.c used to have, for comparison.
+static void*
+bytememmove(void *dst, const void *src, uint n)
+{
+  const char *s = src;
+  char *d = dst;
+
+  while(n-- > 0)
+    *d++ = *s++;
+  return dst;
+}
+
+static void*
+bytememset(void *dst, int c, uint n)
+{
+  char *d = dst;
+
+  while(n-- > 0)
+    *d++ = c;
+  return dst;
+}
+
+static int
+bytememcmp(const void *v1, const void *v2, uint n)
+{
+  const uchar *s1 = v1, *s2 = v2;
+
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+  return 0;
+}
+
+static int
+bytestrlen(const char *s)
+{
+  int n;
+
+  for(n = 0; s[n]; n++)
+    ;
+  return n;
+}
+
+// print n bytes in c cycles as bytes/cycle, to two decimals.
+static void
+report(char *name, int off, int n, uint64 c)
+{
+  uint64 r;
+
+  if(c == 0)
+    c = 1;
+  r = (uint64)n * NREP * 100 / c;
+  printf("  %s", name);
+  for(int i = strlen(name); i < 12; i++)
+    printf(" ");
+  printf("off %d  %d bytes: %ld.%ld%ld bytes/cycle\n",
+         off, n, r / 100, (r / 10) % 10, r % 10);
+}
+
+// time NREP calls of one routine on n bytes at dst and src.
+static uint64
+measure(int which, char *dst, char *src, int n)
+{
+  volatile int sink = 0;
+  uint64 t0 = r_cycle();
+
+  for(int i = 0; i < NREP; i++){
+    switch(which){
+    case 0: memmove(dst, src, n); break;
+    case 1: bytememmove(dst, src, n); break;
+    case 2: memset(dst, i, n); break;
+    case 3: bytememset(dst, i, n); break;
+    case 4: sink += memcmp(dst, src, n); break;
+    case 5: sink += bytememcmp(dst, src, n); break;
+    case 6: sink += strlen(src); break;
+    case 7: sink += bytestrlen(src); break;
+    }
+  }
+  (void)sink;
+  return r_cycle() - t0;
+}
+
+void
+stringbench(void)
+{
+  static char *names[] = {
+    "memmove", "byte memmove", "memset", "byte memset",
+    "memcmp", "byte memcmp", "strlen", "byte strlen",
+  };
+  char *dst, *src;
+
+  if((dst = kalloc()) == 0 || (src = kalloc()) == 0)
+    panic("stringbench");
+
+  printf("string.c benchmark:\n");
+  for(int which = 0; which < NELEM(names); which++){
+    for(int s = 0; s < NELEM(sizes); s++){
+      // aligned, then with src one byte off.
+      for(int off = 0; off < 2; off++){
+        int n = sizes[s];
+        memset(src, 'x', PGSIZE);
+        memset(dst, 'x', PGSIZE);
+        src[off + n] = 0;   // for strlen
+        measure(which, dst, src + off, n);  // warm up
+        report(names[which], off, n, measure(which, dst, src + off, n));
+      }
+    }
+  }
+
+  kfree(dst);
+  kfree(src);
+}
@@ -54,8 +54,9 @@ binit(void)
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
-// In either case, return locked buffer.
-static struct buf*
+// In either case, return locked buffer, which may not
+// hold the block's contents yet; see bfill().
+struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
@@ -95,11 +96,19 @@ bread(uint dev, uint blockno)
   struct buf *b;
 
   b = bget(dev, blockno);
+  bfill(b);
+  return b;
+}
+
+// Read b's block from disk, unless b already holds it.
+// b must be locked.
+void
+bfill(struct buf *b)
+{
   if(!b->valid) {
     virtio_disk_rw(b, 0);
     b->valid = 1;
   }
-  return b;
 }
 
 // Write b's contents to disk.  Must be locked.
@@ -1,5 +1,13 @@
 struct buf;
 struct context;
+struct fpstate;
+struct vecstate;
+struct rbtree;
+struct sched_attr;
+struct groupstat;
+struct spawnact;
+struct rbnode;
+struct timer;
 struct file;
 struct inode;
 struct pipe;
@@ -10,9 +18,14 @@ struct stat;
 struct superblock;
 struct list;
 
+// bench.c
+void            stringbench(void);
+
 // bio.c
 void            binit(void);
+struct buf*     bget(uint, uint);
 struct buf*     bread(uint, uint);
+void            bfill(struct buf*);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
@@ -23,8 +36,16 @@ void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// dtb.c
+extern uint64   dtbpa;
+extern uint64   phystop;
+extern int      ncpu;
+extern uint64   timebase;
+void            dtbinit(void);
+
 // exec.c
 int             exec(char*, char**);
+int             loadimage(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -51,6 +72,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             preadi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -64,12 +86,17 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void*           kbootalloc(uint64);
+void            kincref(void *);
+int             kgetref(void *);
+int             kputref(void *);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            log_sync(void);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -84,10 +111,10 @@ void            printfinit(void);
 
 // proc.c
 int             cpuid(void);
+void            cpuinit(void);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
@@ -101,15 +128,26 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+void            kthread(void (*)(void *), void *, char *);
 int             wait(uint64);
+int             waitpid(int, uint64, int);
+int             spawn(char*, char**, struct spawnact*, int);
 void            wakeup(void*);
+void            wakeupone(void*);
+void            wakeupsync(void*);
+int             setaffinity(int, uint64);
+int             getaffinity(int, uint64*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            fpsaveproc(struct proc*);
+void            fploadproc(struct proc*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
+void            fpsave(struct fpstate*);
+void            fpload(struct fpstate*);
 
 // spinlock.c
 void            acquire(struct spinlock*);
@@ -119,6 +157,32 @@ void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// sched.c
+void            runqinit(void);
+void            setrunnable(struct proc*);
+void            schedhandoff(struct proc*);
+void            schedunhandoff(void);
+struct proc*    runqpick(struct cpu*);
+int             schedtick(struct proc*);
+void            schedinit(struct proc*, struct proc*);
+void            schedstop(struct proc*);
+void            schedquota(struct cpu*, struct proc*);
+int             nice(int);
+void            schedyield(void);
+int             schedsetdl(struct proc*, uint64, uint64, uint64);
+void            schedgetdl(struct proc*, struct sched_attr*);
+int             schedsetaffinity(struct proc*, uint64);
+int             groupcreate(struct proc*, uint64, uint64);
+int             groupjoin(struct proc*, int);
+void            groupexit(struct proc*);
+int             groupstat(int, struct groupstat*);
+
+// rbtree.c
+void            rb_insert(struct rbtree*, struct rbnode*, int (*)(struct rbnode*, struct rbnode*));
+void            rb_erase(struct rbtree*, struct rbnode*);
+struct rbnode*  rb_first(struct rbtree*);
+struct rbnode*  rb_next(struct rbnode*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -131,6 +195,7 @@ void*           memmove(void*, const void*, uint);
 void*           memset(void*, int, uint);
 char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
+uint            strnlen(const char*, uint);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
@@ -142,8 +207,19 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+void            timerqinit(void);
+void            inittimer(struct timer*, void (*)(void*), void*);
+void            settimer(struct timer*, uint64);
+void            settimerticks(struct timer*, uint64);
+int             canceltimer(struct timer*);
+int             timerpending(struct timer*);
+void            timerintr(void);
+int             sleepuntil(uint64);
+int             sleepticks(int);
+
 // trap.c
-extern uint     ticks;
+void            kickcpu(struct cpu*);
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
@@ -156,9 +232,21 @@ void            uartputc(int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
+// uring.c
+void            uringinit(void);
+int             uringmap(struct proc*, pagetable_t);
+int             uringsetup(struct proc*);
+void            uringdrain(struct proc*);
+void            uringfree(struct proc*);
+int             uringenter(struct proc*, int);
+
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+pagetable_t     kvmcreate(pagetable_t);
+void            kvmswitch(pagetable_t, pagetable_t);
+int             uvmkshare(pagetable_t);
+void            uvmkunshare(pagetable_t);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
@@ -170,6 +258,9 @@ void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
+pte_t *         walkw(pagetable_t, uint64, int);
+int             uvmcow(pagetable_t, uint64);
+int             uvmcheck(pagetable_t, uint64, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -181,6 +272,22 @@ void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// vec.c
+extern int      hasvec;
+void            vecinit(void);
+void            vecsaveproc(struct proc*);
+int             vecloadproc(struct proc*);
+int             veccopy(struct proc*, struct proc*);
+void            vecfree(struct proc*);
+void*           kmemcpy(void*, const void*, uint);
+void*           kmemset(void*, int, uint);
+
+// vec.S
+void            vecsave(struct vecstate*);
+void            vecload(struct vecstate*);
+void            vecmemmove(void*, const void*, uint64);
+void            vecmemset(void*, int, uint64);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
@@ -0,0 +1,143 @@
+// Minimal reader for the flattened device tree (DTB) that
+// qemu passes to the kernel in a1, just enough to find out
+// how much RAM and how many harts this machine has, and how
+// fast r_time() counts.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define FDT_MAGIC      0xd00dfeed
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE   2
+#define FDT_PROP       3
+#define FDT_NOP        4
+#define FDT_END        9
+
+#define MAXDEPTH       16  // deepest node we look into
+
+// all fields are big-endian.
+struct fdt_header {
+  uint magic;
+  uint totalsize;
+  uint off_dt_struct;
+  uint off_dt_strings;
+  uint off_mem_rsvmap;
+  uint version;
+  uint last_comp_version;
+  uint boot_cpuid_phys;
+  uint size_dt_strings;
+  uint size_dt_struct;
+};
+
+uint64 dtbpa;             // set by start() from a1 on hart 0
+uint64 phystop = PHYSTOP; // end of RAM, from the memory node
+int ncpu = NCPU;          // number of harts, from the cpu nodes
+uint64 timebase = 10000000; // r_time() ticks per second
+
+static uint
+be32(uint x)
+{
+  return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+// read a big-endian number made of n 32-bit cells.
+static uint64
+cells(uint *p, int n)
+{
+  uint64 x = 0;
+
+  while(n-- > 0)
+    x = (x << 32) | be32(*p++);
+  return x;
+}
+
+// Scan the device tree for the memory node that starts at
+// KERNBASE, for nodes with device_type "cpu", and for the
+// timebase-frequency, and set phystop, ncpu and timebase.
+// Leaves the compiled-in defaults alone if there is no
+// device tree. Must run before anything allocates memory
+// or looks at cpus[].
+void
+dtbinit(void)
+{
+  struct fdt_header *h = (struct fdt_header *)dtbpa;
+  int acells[MAXDEPTH], scells[MAXDEPTH];  // #address-cells, #size-cells
+  int type[MAXDEPTH];                      // 1 memory, 2 cpu
+  int disabled[MAXDEPTH];
+  uint *reg[MAXDEPTH];
+  int depth = 0, harts = 0;
+  uint64 base, size;
+  char *strings;
+  uint *p;
+
+  if(h == 0 || be32(h->magic) != FDT_MAGIC)
+    return;
+  strings = (char *)h + be32(h->off_dt_strings);
+  p = (uint *)((char *)h + be32(h->off_dt_struct));
+  acells[0] = 2;
+  scells[0] = 1;
+
+  for(;;){
+    uint tok = be32(*p++);
+    if(tok == FDT_BEGIN_NODE){
+      // skip the nul-terminated name, padded to 4 bytes.
+      p += (strlen((char *)p) + 4) / 4;
+      if(++depth >= MAXDEPTH)
+        return;
+      acells[depth] = 2;
+      scells[depth] = 1;
+      type[depth] = 0;
+      disabled[depth] = 0;
+      reg[depth] = 0;
+    } else if(tok == FDT_END_NODE){
+      if(depth <= 0)
+        return;
+      if(type[depth] == 2 && !disabled[depth])
+        harts++;
+      if(type[depth] == 1 && reg[depth]){
+        // reg is laid out according to the parent's cells.
+        base = cells(reg[depth], acells[depth-1]);
+        size = cells(reg[depth] + acells[depth-1], scells[depth-1]);
+        if(base == KERNBASE && size >= PHYSTOP - KERNBASE){
+          if(size > PHYSMAX - KERNBASE)
+            size = PHYSMAX - KERNBASE;
+          phystop = base + size;
+        }
+      }
+      depth--;
+    } else if(tok == FDT_PROP){
+      uint len = be32(p[0]);
+      char *name = strings + be32(p[1]);
+      char *val = (char *)(p + 2);
+      p += 2 + (len + 3) / 4;
+      if(depth <= 0)
+        continue;
+      if(strncmp(name, "#address-cells", 15) == 0)
+        acells[depth] = be32(*(uint *)val);
+      else if(strncmp(name, "#size-cells", 12) == 0)
+        scells[depth] = be32(*(uint *)val);
+      else if(strncmp(name, "device_type", 12) == 0 &&
+              strncmp(val, "memory", 7) == 0)
+        type[depth] = 1;
+      else if(strncmp(name, "device_type", 12) == 0 &&
+              strncmp(val, "cpu", 4) == 0)
+        type[depth] = 2;
+      else if(strncmp(name, "status", 7) == 0 &&
+              strncmp(val, "disabled", 9) == 0)
+        disabled[depth] = 1;
+      else if(strncmp(name, "reg", 4) == 0)
+        reg[depth] = (uint *)val;
+      else if(strncmp(name, "timebase-frequency", 19) == 0 &&
+              (len == 4 || len == 8))
+        timebase = cells((uint *)val, len / 4);
+    } else if(tok != FDT_NOP){
+      break;  // FDT_END, or something we don't understand
+    }
+  }
+
+  if(harts > 0)
+    ncpu = harts < NCPU ? harts : NCPU;
+}
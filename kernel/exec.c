@@ -19,8 +19,13 @@ int flags2perm(int flags)
     return perm;
 }
 
+// Load the program in path into a new user image for p, with
+// arguments argv, and switch p to it. p is the current process,
+// or a new one that spawn() is building; path is looked up
+// from the current process's directory.
+// Returns argc, or -1 with p unchanged.
 int
-exec(char *path, char **argv)
+loadimage(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -29,7 +34,6 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
 
   begin_op();
 
@@ -72,7 +76,6 @@ exec(char *path, char **argv)
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate some pages at the next page boundary.
@@ -126,9 +129,10 @@ exec(char *path, char **argv)
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
+  kvmswitch(p->kpagetable, pagetable);
   proc_freepagetable(oldpagetable, oldsz);
 
-  return argc; // this ends up in a0, the first argument to main(argc, argv)
+  return argc;
 
  bad:
   if(pagetable)
@@ -140,6 +144,31 @@ exec(char *path, char **argv)
   return -1;
 }
 
+int
+exec(char *path, char **argv)
+{
+  struct proc *p = myproc();
+  int argc;
+
+  // the rings survive exec, but the workers mustn't be
+  // using the old image's memory when it goes.
+  uringdrain(p);
+
+  if((argc = loadimage(p, path, argv)) < 0)
+    return -1;
+
+  // the new image starts with zeroed FP registers; drop any
+  // live copy so that sched() won't save it.
+  push_off();
+  w_sstatus(r_sstatus() & ~SSTATUS_FS);
+  p->fpcpu = -1;
+  pop_off();
+  memset(&p->fpstate, 0, sizeof(p->fpstate));
+  vecfree(p);
+
+  return argc; // this ends up in a0, the first argument to main(argc, argv)
+}
+
 // Load a program segment into pagetable at virtual address va.
 // va must be page-aligned
 // and the pages from va to va+sz must already be mapped.
@@ -495,6 +495,36 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Read data from inode into kernel memory, like readi(), but
+// hold ip->lock only while finding each block, not while
+// waiting for the disk, so that reads of one file can be in
+// flight together. Claiming the block's buffer before letting
+// go of ip->lock keeps the block from being reused by another
+// file (balloc() must lock it to zero it) until it has been
+// copied. Caller must not hold ip->lock.
+int
+preadi(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint tot, m, addr;
+  struct buf *bp;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    ilock(ip);
+    if(off >= ip->size || (addr = bmap(ip, off/BSIZE)) == 0){
+      iunlock(ip);
+      break;
+    }
+    m = min(n - tot, BSIZE - off%BSIZE);
+    m = min(m, ip->size - off);
+    bp = bget(ip->dev, addr);
+    iunlock(ip);
+    bfill(bp);
+    memmove(dst, bp->data + (off % BSIZE), m);
+    brelse(bp);
+  }
+  return tot;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -9,8 +9,6 @@
 #include "riscv.h"
 #include "defs.h"
 
-void freerange(void *pa_start, void *pa_end);
-
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
@@ -18,39 +16,73 @@ struct run {
   struct run *next;
 };
 
+// index of the reference count for physical page pa.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+// pages from kmem.next up to phystop have never been
+// allocated. kalloc() takes them one at a time once the
+// freelist is empty, so boot doesn't have to touch every
+// page of RAM, and pages join the freelist only when freed.
 struct {
   struct spinlock lock;
   struct run *freelist;
+  char *start;  // first page kalloc() hands out
+  char *next;   // first page never handed out
+  // number of page tables (or kernel users) referring to each
+  // page, so copy-on-write fork can share pages and leaf
+  // page-table pages. protected by lock.
+  int *ref;
 } kmem;
 
-void
-kinit()
+// next free byte for kbootalloc().
+static char *bootnext = end;
+
+// Allocate zeroed memory right after the kernel, for tables
+// whose size depends on the machine (see dtbinit()). Only
+// before kinit(), which hands out the pages after them.
+void *
+kbootalloc(uint64 n)
 {
-  initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  char *p;
+
+  if(kmem.start)
+    panic("kbootalloc");
+  p = (char*)(((uint64)bootnext + 15) & ~15L);
+  bootnext = p + n;
+  memset(p, 0, n);
+  return p;
 }
 
 void
-freerange(void *pa_start, void *pa_end)
+kinit()
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  initlock(&kmem.lock, "kmem");
+  kmem.ref = kbootalloc((phystop - KERNBASE) / PGSIZE * sizeof(int));
+  kmem.start = (char*)PGROUNDUP((uint64)bootnext);
+  kmem.next = kmem.start;
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by pa, which should have been returned by a
+// call to kalloc().
+// The page is freed when its last reference goes away.
 void
 kfree(void *pa)
 {
   struct run *r;
 
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < kmem.start || (char*)pa >= kmem.next)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] < 1)
+    panic("kfree: ref");
+  if(--kmem.ref[PA2REF(pa)] > 0){
+    release(&kmem.lock);
+    return;
+  }
+  release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
@@ -72,11 +104,58 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+  } else if(kmem.next + PGSIZE <= (char*)phystop){
+    r = (struct run*)kmem.next;
+    kmem.next += PGSIZE;
+  }
+  if(r)
+    kmem.ref[PA2REF(r)] = 1;
   release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Add a reference to an allocated page, e.g. when
+// fork shares it with the child's page table.
+void
+kincref(void *pa)
+{
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] < 1)
+    panic("kincref");
+  kmem.ref[PA2REF(pa)]++;
+  release(&kmem.lock);
+}
+
+// Return the number of references to an allocated page.
+int
+kgetref(void *pa)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.ref[PA2REF(pa)];
+  release(&kmem.lock);
+  return n;
+}
+
+// Drop a reference to pa unless the caller holds the last one.
+// Returns 1 if it was the last reference, in which case the page
+// stays allocated so the caller can tear down what it points to
+// before calling kfree().
+int
+kputref(void *pa)
+{
+  int last;
+
+  acquire(&kmem.lock);
+  last = kmem.ref[PA2REF(pa)] == 1;
+  if(!last)
+    kmem.ref[PA2REF(pa)]--;
+  release(&kmem.lock);
+  return last;
+}
@@ -43,6 +43,7 @@ struct log {
   int size;
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int ncommit;     // commits finished, for log_sync()
   int dev;
   struct logheader lh;
 };
@@ -157,9 +158,9 @@ end_op(void)
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+    // and decrementing log.outstanding has freed
+    // the space reserved for one operation.
+    wakeupone(&log);
   }
   release(&log.lock);
 
@@ -169,11 +170,31 @@ end_op(void)
     commit();
     acquire(&log.lock);
     log.committing = 0;
+    log.ncommit++;
     wakeup(&log);
+    wakeup(&log.ncommit);
     release(&log.lock);
   }
 }
 
+// Wait until the blocks logged by operations that have
+// already called end_op() are on disk, for fsync.
+void
+log_sync(void)
+{
+  int target;
+
+  acquire(&log.lock);
+  if(log.committing || log.outstanding > 0){
+    // the commit in progress, or the one that the last
+    // outstanding operation will do, includes them.
+    target = log.ncommit + 1;
+    while(log.ncommit < target)
+      sleep(&log.ncommit, &log.lock);
+  }
+  release(&log.lock);
+}
+
 // Copy modified blocks from cache to log.
 static void
 write_log(void)
@@ -11,12 +11,30 @@ void
 main()
 {
   if(cpuid() == 0){
+#ifdef BENCH
+    uint64 t0 = r_time(), t1, t2, t3;
+#endif
+    dtbinit();       // RAM size and hart count
+    cpuinit();       // per-CPU state
     consoleinit();
     printfinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
+    vecinit();       // vector extension?
+#ifdef BENCH
+    t1 = r_time();
+#endif
     kinit();         // physical page allocator
+#ifdef BENCH
+    t2 = r_time();
+    stringbench();
+    t3 = r_time();
+    // init prints when it starts sh; see ci/bootbench.sh.
+    printf("bench: main at %ld us, kinit %ld us, stringbench %ld us\n",
+           t0 * 1000000 / timebase, (t2 - t1) * 1000000 / timebase,
+           (t3 - t2) * 1000000 / timebase);
+#endif
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
@@ -29,12 +47,16 @@ main()
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
+    uringinit();     // asynchronous I/O workers
     __sync_synchronize();
     started = 1;
   } else {
     while(started == 0)
       ;
     __sync_synchronize();
+    if(cpuid() >= ncpu)
+      for(;;)
+        asm volatile("wfi");
     printf("hart %d starting\n", cpuid());
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
@@ -14,8 +14,19 @@
 
 // the kernel uses physical memory thus:
 // 80000000 -- entry.S, then kernel text and data
-// end -- start of kernel page allocation area
-// PHYSTOP -- end RAM used by the kernel
+// end -- boot-time allocations (see kbootalloc())
+// then the kernel page allocation area
+// phystop -- end RAM used by the kernel, from the device tree
+
+// core local interruptor (CLINT). writing 1 to a hart's msip
+// register raises a machine-mode software interrupt on it; see
+// machinevec in kernelvec.S. user memory covers this address in
+// the per-process kernel page tables, so the kernel maps the
+// msip registers at CLINTVA instead.
+#define CLINT 0x02000000L
+#define CLINT_MSIP(hart) (CLINT + 4*(hart))
+#define CLINTVA 0x40000000L
+#define KCLINT_MSIP(hart) (CLINTVA + 4*(hart))
 
 // qemu puts UART registers here in physical memory.
 #define UART0 0x10000000L
@@ -35,16 +46,21 @@
 
 // the kernel expects there to be RAM
 // for use by the kernel and user pages
-// from physical address 0x80000000 to PHYSTOP.
+// from physical address 0x80000000 to phystop,
+// which dtbinit() reads from the device tree.
+// PHYSTOP is the smallest amount (and the amount
+// assumed without a device tree); the kernel
+// won't use RAM beyond PHYSMAX.
 #define KERNBASE 0x80000000L
 #define PHYSTOP (KERNBASE + 128*1024*1024)
+#define PHYSMAX (KERNBASE + 64L*1024*1024*1024)
 
 // map the trampoline page to the highest address,
 // in both user and kernel space.
 #define TRAMPOLINE (MAXVA - PGSIZE)
 
-// map kernel stacks beneath the trampoline,
-// each surrounded by invalid guard pages.
+// map kernel stacks beneath the trampoline as processes
+// need them, each surrounded by invalid guard pages.
 #define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
 
 // User memory layout.
@@ -54,6 +70,14 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   MAXUSER (user memory ends below the PLIC, so that each
+//            process's kernel page table can map it too)
+//   ...
+//   URING (p->uring's rings, if it has them; see uring.h)
+//   VDSO (p->vdso, read-only to user code; see vdso.h)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
+#define MAXUSER PLIC
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define VDSO (TRAPFRAME - PGSIZE)
+#define URING (VDSO - PGSIZE)
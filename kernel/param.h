@@ -1,5 +1,8 @@
-#define NPROC        64  // maximum number of processes
-#define NCPU          8  // maximum number of CPUs
+#define NPROC      4096  // maximum number of processes
+#define NCPU         64  // maximum number of CPUs
+#define NLEVEL        3  // scheduling priority levels
+#define TICKHZ       10  // scheduler clock ticks per second
+#define NGROUP       16  // CPU quota groups
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -8,7 +11,8 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NIOWORKER     8  // kernel threads running uring requests
+#define NBUF         (MAXOPBLOCKS*3+NIOWORKER)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
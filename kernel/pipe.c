@@ -86,7 +86,7 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
+      wakeupsync(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     } else {
       char ch;
@@ -96,7 +96,10 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       i++;
     }
   }
-  wakeup(&pi->nread);
+  // the writer usually waits for a reply next; if it goes
+  // back to user space first, schedunhandoff() lets the
+  // reader go elsewhere.
+  wakeupsync(&pi->nread);
   release(&pi->lock);
 
   return i;
@@ -5,57 +5,112 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "wait.h"
+#include "spawn.h"
+#include "vdso.h"
 
-struct cpu cpus[NCPU];
-
-struct proc proc[NPROC];
+struct cpu *cpus;
 
 struct proc *initproc;
 
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// live processes, hashed by pid, for findproc().
+// pid_lock protects the table and the p->pidnext links.
+#define NPIDHASH 256
+static struct proc *pidhash[NPIDHASH];
+
+// kernel stacks: a bit for each of the NPROC slots below
+// the trampoline that has one mapped.
+struct {
+  struct spinlock lock;
+  uint64 used[NPROC/64];
+} kstacks;
+
+extern pagetable_t kernel_pagetable;
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void adopt(struct proc *p, struct proc *np);
+static void orphan(struct proc *p);
+static void waitqinit(void);
 
 extern char trampoline[]; // trampoline.S
 
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
-// must be acquired before any p->lock.
-struct spinlock wait_lock;
+// wait locks, hashed by process; see waitlock().
+// the one for p helps ensure that wakeups of p
+// wait()ing are not lost, and protects the list
+// of p's children, including their p->parent.
+// must be acquired before any p->lock, and any
+// other process's before initproc's.
+#define NWAITLOCK 16
+struct spinlock waitlocks[NWAITLOCK];
+
+// Allocate a page for a process's kernel stack, and map it
+// high in memory, followed by an invalid guard page. Every
+// process's kernel page table sees the mapping, since they
+// share the kernel's page-table pages up there.
+// Returns its virtual address, or 0 if out of stacks or memory.
+static uint64
+kstackalloc(void)
+{
+  char *pa;
+  int i;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
+  if((pa = kalloc()) == 0)
+    return 0;
+  acquire(&kstacks.lock);
+  for(i = 0; i < NPROC; i += 64)
+    if(kstacks.used[i/64] != ~0UL)
+      break;
+  while(i < NPROC && (kstacks.used[i/64] & (1UL << (i%64))))
+    i++;
+  if(i == NPROC){
+    release(&kstacks.lock);
+    kfree(pa);
+    return 0;
+  }
+  kstacks.used[i/64] |= 1UL << (i%64);
+  release(&kstacks.lock);
+  // kvmmake() made the page-table pages, so this can't fail.
+  if(mappages(kernel_pagetable, KSTACK(i), PGSIZE, (uint64)pa, PTE_R | PTE_W) < 0)
+    panic("kstackalloc");
+  return KSTACK(i);
+}
+
+// Unmap and free a kernel stack. No hart can still have the
+// old mapping cached: each flushes its TLB when it switches to
+// a process, and only its own process uses a kernel stack.
+static void
+kstackfree(uint64 va)
+{
+  int i = (TRAMPOLINE - va) / (2*PGSIZE) - 1;
+
+  uvmunmap(kernel_pagetable, va, 1, 1);
+  acquire(&kstacks.lock);
+  kstacks.used[i/64] &= ~(1UL << (i%64));
+  release(&kstacks.lock);
+}
+
+// Allocate the per-CPU state, once dtbinit()
+// knows how many harts there are.
 void
-proc_mapstacks(pagetable_t kpgtbl)
+cpuinit(void)
 {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
+  cpus = kbootalloc(ncpu * sizeof(struct cpu));
 }
 
-// initialize the proc table.
+// initialize the process bookkeeping.
 void
 procinit(void)
 {
-  struct proc *p;
-  
   initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
-  }
+  for(int i = 0; i < NWAITLOCK; i++)
+    initlock(&waitlocks[i], "wait_lock");
+  initlock(&kstacks.lock, "kstacks");
+  waitqinit();
+  runqinit();
 }
 
 // Must be called with interrupts disabled,
@@ -89,54 +144,104 @@ myproc(void)
   return p;
 }
 
-int
-allocpid()
+static struct proc**
+pidslot(int pid)
 {
-  int pid;
-  
+  return &pidhash[(uint)pid % NPIDHASH];
+}
+
+// give p a pid, and make findproc() able to find it.
+static void
+allocpid(struct proc *p)
+{
+  struct proc **pp;
+
   acquire(&pid_lock);
-  pid = nextpid;
+  p->pid = nextpid;
   nextpid = nextpid + 1;
+  pp = pidslot(p->pid);
+  p->pidnext = *pp;
+  *pp = p;
   release(&pid_lock);
+}
 
-  return pid;
+// Return the live process with the given pid, with its
+// lock held, or 0 if there is none.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  acquire(&pid_lock);
+  for(p = *pidslot(pid); p; p = p->pidnext){
+    if(p->pid == pid){
+      // freeproc() takes p->lock after unhashing p, so
+      // p can't go away while we hold it.
+      acquire(&p->lock);
+      break;
+    }
+  }
+  release(&pid_lock);
+  return p;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Allocate a proc and a kernel stack for it, and initialize
+// the state required to run in the kernel. Returns with
+// p->lock held, or 0 if a memory allocation fails.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
+  if((p = (struct proc *)kalloc()) == 0)
+    return 0;
+  // No FP state yet, so the first FP instruction loads zeros;
+  // nor vector state, which vecloadproc() allocates.
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  p->fpcpu = -1;
+  p->veccpu = -1;
+  if((p->kstack = kstackalloc()) == 0){
+    kfree(p);
+    return 0;
   }
-  return 0;
 
-found:
-  p->pid = allocpid();
+  acquire(&p->lock);
+  allocpid(p);
   p->state = USED;
+  schedinit(p, myproc());
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    release(&p->lock);
     freeproc(p);
+    return 0;
+  }
+
+  // Allocate the page user code reads the time and pid from.
+  if((p->vdso = (struct vdso *)kalloc()) == 0){
     release(&p->lock);
+    freeproc(p);
     return 0;
   }
+  memset(p->vdso, 0, PGSIZE);
+  p->vdso->timebase = timebase;
+  p->vdso->ticktime = TICKTIME;
+  p->vdso->pid = p->pid;
 
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
+    release(&p->lock);
     freeproc(p);
+    return 0;
+  }
+
+  // A kernel page table that also maps the user memory.
+  p->kpagetable = kvmcreate(p->pagetable);
+  if(p->kpagetable == 0){
     release(&p->lock);
+    freeproc(p);
     return 0;
   }
 
@@ -150,29 +255,43 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// including user pages. p must not be running, or on any
+// run queue, wait queue or child list; p->lock must not be held.
 static void
 freeproc(struct proc *p)
 {
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = pidslot(p->pid); *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  release(&pid_lock);
+  // wait out anyone who found p before it was unhashed.
+  acquire(&p->lock);
+  p->state = UNUSED;
+  release(&p->lock);
+
   if(p->trapframe)
     kfree((void*)p->trapframe);
-  p->trapframe = 0;
+  if(p->vdso)
+    kfree((void*)p->vdso);
+  uringfree(p);
+  vecfree(p);
+  if(p->kpagetable)
+    kfree((void*)p->kpagetable);
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
-  p->pid = 0;
-  p->parent = 0;
-  p->name[0] = 0;
-  p->chan = 0;
-  p->killed = 0;
-  p->xstate = 0;
-  p->state = UNUSED;
+  groupexit(p);
+  kstackfree(p->kstack);
+  kfree((void*)p);
 }
 
 // Create a user page table for a given process, with no user memory,
-// but with trampoline and trapframe pages.
+// but with trampoline, trapframe and vdso pages.
 pagetable_t
 proc_pagetable(struct proc *p)
 {
@@ -202,6 +321,37 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the vdso page just below that, read-only to user code.
+  if(mappages(pagetable, VDSO, PGSIZE,
+              (uint64)(p->vdso), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
+  // and the asynchronous I/O rings, if p has them.
+  if(uringmap(p, pagetable) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, VDSO, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
+  // the kernel's devices above MAXUSER, so that the
+  // process's kernel page table can share the user
+  // mappings (see kvmcreate()).
+  if(uvmkshare(pagetable) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, VDSO, 1, 0);
+    if(walkaddr(pagetable, URING))
+      uvmunmap(pagetable, URING, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -212,6 +362,10 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
+  if(walkaddr(pagetable, URING))
+    uvmunmap(pagetable, URING, 1, 0);
+  uvmkunshare(pagetable);
   uvmfree(pagetable, sz);
 }
 
@@ -249,7 +403,7 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -268,12 +422,61 @@ growproc(int n)
       return -1;
     }
   } else if(n < 0){
+    // the rings' workers may be using the memory.
+    uringdrain(p);
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
+  // the kernel page table in satp maps user memory too.
+  sfence_vma();
   p->sz = sz;
   return 0;
 }
 
+// p's wait lock. procs are pages from kalloc().
+static struct spinlock*
+waitlock(struct proc *p)
+{
+  return &waitlocks[((uint64)p >> PGSHIFT) % NWAITLOCK];
+}
+
+// Acquire the wait lock of p's parent, which can change
+// until we hold it, and return the parent.
+static struct proc*
+lockparent(struct proc *p)
+{
+  struct proc *pp;
+
+  for(;;){
+    pp = __atomic_load_n(&p->parent, __ATOMIC_RELAXED);
+    acquire(waitlock(pp));
+    if(p->parent == pp)
+      return pp;
+    release(waitlock(pp));
+  }
+}
+
+// Put np on p's list of children.
+// Caller must hold p's wait lock.
+static void
+adopt(struct proc *p, struct proc *np)
+{
+  np->sibling = p->children;
+  if(np->sibling)
+    np->sibling->psibling = &np->sibling;
+  p->children = np;
+  np->psibling = &p->children;
+}
+
+// Take p off its parent's list of children.
+// Caller must hold the parent's wait lock.
+static void
+orphan(struct proc *p)
+{
+  *p->psibling = p->sibling;
+  if(p->sibling)
+    p->sibling->psibling = p->psibling;
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
@@ -283,6 +486,10 @@ fork(void)
   struct proc *np;
   struct proc *p = myproc();
 
+  // the rings' workers mustn't write memory that is
+  // about to become copy-on-write.
+  uringdrain(p);
+
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
@@ -290,14 +497,23 @@ fork(void)
 
   // Copy user memory from parent to child.
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
-    freeproc(np);
     release(&np->lock);
+    freeproc(np);
     return -1;
   }
   np->sz = p->sz;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
+  push_off();
+  fpsaveproc(p);
+  pop_off();
+  np->fpstate = p->fpstate;
+  if(veccopy(p, np) < 0){
+    release(&np->lock);
+    freeproc(np);
+    return -1;
+  }
 
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
@@ -314,30 +530,121 @@ fork(void)
 
   release(&np->lock);
 
-  acquire(&wait_lock);
+  acquire(waitlock(p));
   np->parent = p;
-  release(&wait_lock);
+  adopt(p, np);
+  release(waitlock(p));
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Apply spawn()'s file actions to np's open files.
+// Returns -1 if one is bad.
+static int
+spawnfiles(struct proc *np, struct spawnact *act, int nact)
+{
+  struct file *f;
+
+  for(int i = 0; i < nact; i++){
+    if(act[i].fd < 0 || act[i].fd >= NOFILE || (f = np->ofile[act[i].fd]) == 0)
+      return -1;
+    switch(act[i].op){
+    case SPAWN_CLOSE:
+      np->ofile[act[i].fd] = 0;
+      fileclose(f);
+      break;
+    case SPAWN_DUP2:
+      if(act[i].newfd < 0 || act[i].newfd >= NOFILE)
+        return -1;
+      if(act[i].newfd == act[i].fd)
+        break;
+      if(np->ofile[act[i].newfd])
+        fileclose(np->ofile[act[i].newfd]);
+      np->ofile[act[i].newfd] = filedup(f);
+      break;
+    default:
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Create a new process running the program in path with
+// arguments argv, as fork() and then exec() in the child
+// would, but without copying this process's memory. The
+// child starts with copies of this process's open files,
+// changed by the nact actions in act.
+// Returns the child's pid, or -1.
+int
+spawn(char *path, char **argv, struct spawnact *act, int nact)
+{
+  int i, argc, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+  // loading the image sleeps; np isn't visible to anyone
+  // but kill() until it is on a run queue.
+  release(&np->lock);
+
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = loadimage(np, path, argv)) < 0){
+    freeproc(np);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  if(spawnfiles(np, act, nact) < 0){
+    for(i = 0; i < NOFILE; i++)
+      if(np->ofile[i])
+        fileclose(np->ofile[i]);
+    freeproc(np);
+    return -1;
+  }
+  np->cwd = idup(p->cwd);
+
+  pid = np->pid;
+
+  acquire(waitlock(p));
+  np->parent = p;
+  adopt(p, np);
+  release(waitlock(p));
+
+  acquire(&np->lock);
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
 // Pass p's abandoned children to init.
-// Caller must hold wait_lock.
+// Caller must hold p's wait lock.
 void
 reparent(struct proc *p)
 {
+  struct spinlock *lk = waitlock(initproc);
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  if(p->children == 0)
+    return;
+  if(lk != waitlock(p))
+    acquire(lk);
+  while((pp = p->children) != 0){
+    orphan(pp);
+    pp->parent = initproc;
+    adopt(initproc, pp);
   }
+  wakeup(initproc);
+  if(lk != waitlock(p))
+    release(lk);
 }
 
 // Exit the current process.  Does not return.
@@ -347,10 +654,14 @@ void
 exit(int status)
 {
   struct proc *p = myproc();
+  struct proc *pp;
 
   if(p == initproc)
     panic("init exiting");
 
+  // let the rings' workers finish with p's memory.
+  uringdrain(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -365,20 +676,24 @@ exit(int status)
   end_op();
   p->cwd = 0;
 
-  acquire(&wait_lock);
+  // give back any EDF bandwidth.
+  schedsetdl(p, 0, 0, 0);
 
   // Give any children to init.
+  acquire(waitlock(p));
   reparent(p);
+  release(waitlock(p));
 
   // Parent might be sleeping in wait().
-  wakeup(p->parent);
+  pp = lockparent(p);
+  wakeup(pp);
   
   acquire(&p->lock);
 
   p->xstate = status;
   p->state = ZOMBIE;
 
-  release(&wait_lock);
+  release(waitlock(pp));
 
   // Jump into the scheduler, never to return.
   sched();
@@ -389,48 +704,65 @@ exit(int status)
 // Return -1 if this process has no children.
 int
 wait(uint64 addr)
+{
+  return waitpid(-1, addr, 0);
+}
+
+// Wait for the child process pid, or any child if pid is -1,
+// to exit, and return its pid. With WNOHANG, return 0 instead
+// of waiting if it hasn't exited yet.
+// Return -1 if this process has no such child.
+int
+waitpid(int pid, uint64 addr, int flags)
 {
   struct proc *pp;
-  int havekids, pid;
+  int havekids, cpid;
   struct proc *p = myproc();
+  struct spinlock *lk = waitlock(p);
 
-  acquire(&wait_lock);
+  acquire(lk);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
+    for(pp = p->children; pp; pp = pp->sibling){
+      if(pid != -1 && pp->pid != pid)
+        continue;
+
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      havekids = 1;
+      if(pp->state == ZOMBIE){
+        // Found one.
+        cpid = pp->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                                sizeof(pp->xstate)) < 0) {
           release(&pp->lock);
-          release(&wait_lock);
-          return pid;
+          release(lk);
+          return -1;
         }
         release(&pp->lock);
+        orphan(pp);
+        release(lk);
+        freeproc(pp);
+        return cpid;
       }
+      release(&pp->lock);
     }
 
     // No point waiting if we don't have any children.
     if(!havekids || killed(p)){
-      release(&wait_lock);
+      release(lk);
       return -1;
     }
+    if(flags & WNOHANG){
+      release(lk);
+      return 0;
+    }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, lk);  //DOC: wait-sleep
   }
 }
 
@@ -454,29 +786,49 @@ scheduler(void)
     // processes are waiting.
     intr_on();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
-      }
-      release(&p->lock);
-    }
-    if(found == 0) {
-      // nothing to run; stop running on this core until an interrupt.
-      intr_on();
+    // look for work and wfi with interrupts off, so that a
+    // wakeup can't slip in between; wfi still returns when
+    // an interrupt is pending. from here on, setrunnable()
+    // kicks this CPU if it queues work for it.
+    intr_off();
+    __atomic_store_n(&c->idle, 1, __ATOMIC_SEQ_CST);
+    if((p = runqpick(c)) == 0){
+      // nothing to run; stop the clock tick and stop running
+      // on this core until an interrupt or a kick.
+      canceltimer(&c->slice);
       asm volatile("wfi");
+      continue;
     }
+    c->idle = 0;
+
+    // p was RUNNABLE on a run queue, so it can't have changed
+    // state since; p->lock waits for it to leave its last CPU.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = c - cpus;
+    p->runstart = r_time();
+    c->proc = p;
+    c->sliceout = 0;
+    if(!timerpending(&c->slice))
+      settimer(&c->slice, r_time() + TICKTIME);
+    schedquota(c, p);
+    w_satp(MAKE_SATP(p->kpagetable));
+    sfence_vma();
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    // Leave its kernel page table before releasing p->lock,
+    // since wait() may free it.
+    kvminithart();
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -502,18 +854,56 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  fpsaveproc(p);
+  vecsaveproc(p);
+  // setrunnable() has charged a RUNNABLE p, which
+  // may be on another CPU's queue by now.
+  if(p->state != RUNNABLE)
+    schedstop(p);
+
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
 
+// Save p's FP registers into p->fpstate if it has changed them
+// since they were loaded. They stay loaded, so if p runs on this
+// CPU again, with no one else using FP in between, it can go on
+// using them without a trap. Non-FP processes never get here
+// with sstatus.FS dirty, so they pay nothing.
+// Interrupts must be disabled.
+void
+fpsaveproc(struct proc *p)
+{
+  uint64 x = r_sstatus();
+
+  if((x & SSTATUS_FS) == SSTATUS_FS_DIRTY){
+    fpsave(&p->fpstate);
+    w_sstatus((x & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+  }
+}
+
+// p's first FP instruction since it was last scheduled here
+// trapped because usertrapret() left sstatus.FS off. Load its
+// FP state into this CPU's registers.
+// Interrupts must be disabled.
+void
+fploadproc(struct proc *p)
+{
+  w_sstatus((r_sstatus() & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+  fpload(&p->fpstate);
+  w_sstatus((r_sstatus() & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+  mycpu()->fpproc = p;
+  p->fpcpu = cpuid();
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -542,53 +932,167 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch here.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+  p->kfn(p->karg);
+  panic("kthread returned");
+}
+
+// Start a kernel thread, which runs fn(arg) and must never
+// return. It is a process, so that it can sleep, but it
+// has no user memory and never goes to user space.
+void
+kthread(void (*fn)(void *), void *arg, char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->kfn = fn;
+  p->karg = arg;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  setrunnable(p);
+  release(&p->lock);
+}
+
+// wait queues. sleep() puts a process on the queue for its
+// channel's hash bucket, so wakeup() only has to look at the
+// processes that may be sleeping on that channel. a process
+// stays on its queue until it runs again, so wakeup() still
+// checks p->state. lock order: a wait queue lock, then p->lock.
+#define WAITQBITS 6
+#define NWAITQ    (1 << WAITQBITS)
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc **tail;   // &last->wqnext, or &head
+} waitq[NWAITQ];
+
+static void
+waitqinit(void)
+{
+  for(int i = 0; i < NWAITQ; i++){
+    initlock(&waitq[i].lock, "waitq");
+    waitq[i].tail = &waitq[i].head;
+  }
+}
+
+static struct waitq*
+waitqof(void *chan)
+{
+  return &waitq[((uint64)chan * 0x9e3779b97f4a7c15UL) >> (64 - WAITQBITS)];
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
-  
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  struct waitq *wq = waitqof(chan);
+
+  // Join chan's wait queue before releasing lk, so that
+  // wakeup() finds p. wakeup() then waits for p->lock,
+  // which p holds until sched() has switched away, so
+  // we can't miss it.
+  acquire(&wq->lock);
+  p->chan = chan;
+  p->wqnext = 0;
+  p->wqprev = wq->tail;
+  *wq->tail = p;
+  wq->tail = &p->wqnext;
+  release(&wq->lock);
 
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
-  p->chan = chan;
   p->state = SLEEPING;
 
   sched();
 
+  release(&p->lock);
+
   // Tidy up.
+  acquire(&wq->lock);
+  *p->wqprev = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  else
+    wq->tail = p->wqprev;
   p->chan = 0;
+  release(&wq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
+#define WAKEALL  0
+#define WAKEONE  1  // just the one that has slept longest
+#define WAKESYNC 2  // all, handing off to the first; see wakeupsync()
+
+// wake the processes sleeping on chan.
+static void
+wake(void *chan, int how)
+{
+  struct waitq *wq = waitqof(chan);
+  struct proc *p;
+  int woke, n = 0;
+
+  acquire(&wq->lock);
+  for(p = wq->head; p; p = p->wqnext){
+    if(p->chan != chan || p == myproc())
+      continue;
+    acquire(&p->lock);
+    woke = p->state == SLEEPING;
+    if(woke && how == WAKESYNC && n == 0)
+      schedhandoff(p);
+    else if(woke)
+      setrunnable(p);
+    release(&p->lock);
+    n += woke;
+    if(n > 0 && how == WAKEONE)
+      break;
+  }
+  release(&wq->lock);
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  wake(chan, WAKEALL);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-    }
-  }
+// Wake up one process sleeping on chan, for waiters of which
+// only one can go ahead, like those for a sleep-lock. The
+// one woken must not give up without passing the wakeup on.
+// Must be called without any p->lock.
+void
+wakeupone(void *chan)
+{
+  wake(chan, WAKEONE);
+}
+
+// Wake up all processes sleeping on chan, from a process that
+// is about to block, like a pipe writer that will wait for the
+// reply: the first one woken runs next on this CPU, instead of
+// waiting for another CPU to notice it.
+// Must be called without any p->lock.
+void
+wakeupsync(void *chan)
+{
+  wake(chan, myproc() ? WAKESYNC : WAKEALL);
 }
 
 // Kill the process with the given pid.
@@ -599,20 +1103,57 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
+}
+
+// Restrict the process with the given pid, or the current
+// process if pid is 0, to the CPUs in mask. A process that
+// is waiting to run moves when it next wakes up or yields.
+// Returns -1 if there is no such process, or the mask
+// leaves it nowhere to run.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p, *me = myproc();
+  int r, move;
+
+  if((p = findproc(pid ? pid : me->pid)) == 0)
+    return -1;
+  r = schedsetaffinity(p, mask);
+  release(&p->lock);
+  if(r == 0 && p == me){
+    push_off();
+    move = ((mask >> cpuid()) & 1) == 0;
+    pop_off();
+    if(move)
+      yield();
+  }
+  return r;
+}
+
+// The affinity mask of the process with the given pid, or
+// the current process if pid is 0, in *mask.
+// Returns -1 if there is no such process.
+int
+getaffinity(int pid, uint64 *mask)
+{
+  struct proc *p;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  *mask = p->affinity;
+  release(&p->lock);
+  return 0;
 }
 
 void
@@ -682,14 +1223,14 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
-    if(p->state == UNUSED)
-      continue;
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
-    else
-      state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
-    printf("\n");
+  for(int i = 0; i < NPIDHASH; i++){
+    for(p = pidhash[i]; p; p = p->pidnext){
+      if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
+        state = states[p->state];
+      else
+        state = "???";
+      printf("%d %s %s", p->pid, state, p->name);
+      printf("\n");
+    }
   }
 }
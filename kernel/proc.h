@@ -1,3 +1,6 @@
+#include "rbtree.h"
+#include "timer.h"
+
 // Saved registers for kernel context switches.
 struct context {
   uint64 ra;
@@ -18,15 +21,61 @@ struct context {
   uint64 s11;
 };
 
+// Saved user floating-point registers.
+struct fpstate {
+  /*   0 */ uint64 f[32];
+  /* 256 */ uint64 fcsr;
+};
+
+// Saved user vector state. regs is a page holding
+// v0-v31, allocated when the process first uses vectors.
+struct vecstate {
+  /*   0 */ uint64 vstart;
+  /*   8 */ uint64 vcsr;
+  /*  16 */ uint64 vl;
+  /*  24 */ uint64 vtype;
+  /*  32 */ char *regs;
+};
+
+// Per-CPU queue of RUNNABLE processes; see sched.c.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NLEVEL-1];  // Next to run at each FIFO level
+  struct proc *tail[NLEVEL-1];
+  struct rbtree fair;           // Bottom level, by virtual runtime
+  int n;                        // Length; read without the lock as a hint
+  uint64 load;                  // Total weight of the queued processes
+  uint64 curload;               // Weight of the process running here
+  int curprio;                  // Its level, -1 for EDF
+  struct proc *handoff;         // Queued here, to run next
+  uint64 minvruntime;           // Never more than any queued vruntime
+  struct rbtree dl;             // EDF processes, by deadline
+  struct proc *dlthrottled;     // EDF processes out of runtime
+  uint64 dlbw;                  // EDF bandwidth admitted here; dllock
+  uint epoch;                   // Boost period of the last boost
+  struct timer dltimer;         // Next EDF replenishment
+};
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  struct proc *fpproc;        // Whose FP state the FP registers hold.
+  struct proc *vecproc;       // Whose vector state the vector registers hold.
+  struct runq rq;             // Processes waiting to run here.
+  struct spinlock tlock;
+  struct rbtree timers;       // Pending timers, by expiry; tlock.
+  struct wheel wheel;         // Pending coarse timers; tlock.
+  struct timer slice;         // Scheduler tick, while busy.
+  struct timer quota;         // When the running process's group grant ends.
+  struct timer budget;        // When the running EDF process's runtime ends.
+  int sliceout;               // Has slice expired since schedtick()?
+  int idle;                   // Looking for work, or in wfi; kick it.
 };
 
-extern struct cpu cpus[NCPU];
+extern struct cpu *cpus;  // ncpu of them
 
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
@@ -77,6 +126,8 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+  /* 288 */ uint64 pid;           // for uservec's fast getpid()
+  /* 296 */ uint64 ticktime;      // TICKTIME, for its fast uptime()
 };
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
@@ -88,19 +139,66 @@ struct proc {
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *wqnext;         // chan's wait queue; see sleep()
+  struct proc **wqprev;
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // CPU it last ran on, or -1
+  uint64 affinity;             // CPUs it may run on, a bit each
+  int level;                   // Scheduling priority level, 0 highest
+  int slice;                   // Ticks used of this level's quantum
+  uint epoch;                  // Boost period level is from
+  int nice;                    // -20 to 19; lower gets more CPU
+  int weight;                  // From nice
+  uint64 vruntime;             // Run time divided by weight
+  uint64 runstart;             // r_time() when last charged
+  int group;                   // CPU quota group, 0 for none
+  uint64 grant;                // Group quota taken but not yet used
+  uint64 grantstart;           // Start of the group period it is from
+
+  // EDF class, if dlperiod isn't 0. times in r_time() units.
+  uint64 dlruntime;            // Runtime per period
+  uint64 dlperiod;
+  uint64 dldeadline;           // After the start of each period
+  uint64 dlbw;                 // Runtime/period, for admission control
+  long dlbudget;               // Runtime left in this period
+  uint64 dlabs;                // Absolute deadline of the current job
+  uint64 dlnext;               // Start of the next period
+  int dldone;                  // Current job is done; see schedyield()
+  int dlmisses;                // Deadlines missed
+  int dlcpu;                   // CPU it runs on
 
-  // wait_lock must be held when using this:
+  // the run queue's lock must be held when using this:
+  struct proc *rqnext;         // Next on the run queue
+  struct rbnode rbnode;        // On the run queue's fair or EDF tree
+
+  // pid_lock must be held when using this:
+  struct proc *pidnext;        // Next in pid's hash chain
+
+  // the parent's wait lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *sibling;        // Parent's next child
+  struct proc **psibling;      // What points to this one
+
+  // and this one's for this:
+  struct proc *children;       // First child
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
+  pagetable_t kpagetable;      // Kernel page table that also maps user memory
   struct trapframe *trapframe; // data page for trampoline.S
+  struct vdso *vdso;           // read-only data page for user code
+  struct kuring *uring;        // asynchronous I/O rings, or 0
+  void (*kfn)(void *);         // kernel thread's function; see kthread()
+  void *karg;
   struct context context;      // swtch() here to run process
+  struct fpstate fpstate;      // FP registers, when not loaded
+  int fpcpu;                   // CPU whose FP registers hold fpstate, or -1
+  struct vecstate vecstate;    // Vector registers, when not loaded
+  int veccpu;                  // CPU whose vector registers hold vecstate, or -1
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
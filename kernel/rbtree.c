@@ -0,0 +1,248 @@
+#include "types.h"
+#include "riscv.h"
+#include "rbtree.h"
+#include "defs.h"
+
+// red-black tree whose nodes live inside the structures they
+// order, so that inserting and removing never allocate.
+// callers supply the ordering to rb_insert(); equal keys go
+// after the ones already there. O(log n) insert and erase.
+
+static void
+rotateleft(struct rbtree *t, struct rbnode *x)
+{
+  struct rbnode *y = x->right;
+
+  x->right = y->left;
+  if(y->left)
+    y->left->parent = x;
+  y->parent = x->parent;
+  if(x->parent == 0)
+    t->root = y;
+  else if(x == x->parent->left)
+    x->parent->left = y;
+  else
+    x->parent->right = y;
+  y->left = x;
+  x->parent = y;
+}
+
+static void
+rotateright(struct rbtree *t, struct rbnode *x)
+{
+  struct rbnode *y = x->left;
+
+  x->left = y->right;
+  if(y->right)
+    y->right->parent = x;
+  y->parent = x->parent;
+  if(x->parent == 0)
+    t->root = y;
+  else if(x == x->parent->right)
+    x->parent->right = y;
+  else
+    x->parent->left = y;
+  y->right = x;
+  x->parent = y;
+}
+
+void
+rb_insert(struct rbtree *t, struct rbnode *z,
+          int (*less)(struct rbnode *, struct rbnode *))
+{
+  struct rbnode *p = 0, **link = &t->root;
+  struct rbnode *g, *u;
+
+  while(*link){
+    p = *link;
+    link = less(z, p) ? &p->left : &p->right;
+  }
+  z->parent = p;
+  z->left = z->right = 0;
+  z->red = 1;
+  *link = z;
+
+  while((p = z->parent) != 0 && p->red){
+    g = p->parent;  // p is red, so not the root
+    if(p == g->left){
+      u = g->right;
+      if(u && u->red){
+        p->red = u->red = 0;
+        g->red = 1;
+        z = g;
+      } else {
+        if(z == p->right){
+          z = p;
+          rotateleft(t, z);
+          p = z->parent;
+        }
+        p->red = 0;
+        g->red = 1;
+        rotateright(t, g);
+      }
+    } else {
+      u = g->left;
+      if(u && u->red){
+        p->red = u->red = 0;
+        g->red = 1;
+        z = g;
+      } else {
+        if(z == p->left){
+          z = p;
+          rotateright(t, z);
+          p = z->parent;
+        }
+        p->red = 0;
+        g->red = 1;
+        rotateleft(t, g);
+      }
+    }
+  }
+  t->root->red = 0;
+}
+
+// put v where u is in u's parent.
+static void
+transplant(struct rbtree *t, struct rbnode *u, struct rbnode *v)
+{
+  if(u->parent == 0)
+    t->root = v;
+  else if(u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if(v)
+    v->parent = u->parent;
+}
+
+static int
+isred(struct rbnode *n)
+{
+  return n && n->red;
+}
+
+// x, possibly null, with parent xp, is one black short.
+static void
+erasefixup(struct rbtree *t, struct rbnode *x, struct rbnode *xp)
+{
+  struct rbnode *w;
+
+  while(x != t->root && !isred(x)){
+    if(x == xp->left){
+      w = xp->right;
+      if(w->red){
+        w->red = 0;
+        xp->red = 1;
+        rotateleft(t, xp);
+        w = xp->right;
+      }
+      if(!isred(w->left) && !isred(w->right)){
+        w->red = 1;
+        x = xp;
+        xp = x->parent;
+      } else {
+        if(!isred(w->right)){
+          w->left->red = 0;
+          w->red = 1;
+          rotateright(t, w);
+          w = xp->right;
+        }
+        w->red = xp->red;
+        xp->red = 0;
+        w->right->red = 0;
+        rotateleft(t, xp);
+        x = t->root;
+      }
+    } else {
+      w = xp->left;
+      if(w->red){
+        w->red = 0;
+        xp->red = 1;
+        rotateright(t, xp);
+        w = xp->left;
+      }
+      if(!isred(w->left) && !isred(w->right)){
+        w->red = 1;
+        x = xp;
+        xp = x->parent;
+      } else {
+        if(!isred(w->left)){
+          w->right->red = 0;
+          w->red = 1;
+          rotateleft(t, w);
+          w = xp->left;
+        }
+        w->red = xp->red;
+        xp->red = 0;
+        w->left->red = 0;
+        rotateright(t, xp);
+        x = t->root;
+      }
+    }
+  }
+  if(x)
+    x->red = 0;
+}
+
+void
+rb_erase(struct rbtree *t, struct rbnode *z)
+{
+  struct rbnode *y, *x, *xp;
+  int wasred = z->red;
+
+  if(z->left == 0){
+    x = z->right;
+    xp = z->parent;
+    transplant(t, z, z->right);
+  } else if(z->right == 0){
+    x = z->left;
+    xp = z->parent;
+    transplant(t, z, z->left);
+  } else {
+    // replace z with its successor y.
+    for(y = z->right; y->left; y = y->left)
+      ;
+    wasred = y->red;
+    x = y->right;
+    if(y->parent == z){
+      xp = y;
+    } else {
+      xp = y->parent;
+      transplant(t, y, y->right);
+      y->right = z->right;
+      y->right->parent = y;
+    }
+    transplant(t, z, y);
+    y->left = z->left;
+    y->left->parent = y;
+    y->red = z->red;
+  }
+  if(!wasred)
+    erasefixup(t, x, xp);
+}
+
+// the smallest node, or 0 if t is empty.
+struct rbnode*
+rb_first(struct rbtree *t)
+{
+  struct rbnode *n = t->root;
+
+  if(n)
+    while(n->left)
+      n = n->left;
+  return n;
+}
+
+// the node after n, or 0.
+struct rbnode*
+rb_next(struct rbnode *n)
+{
+  if(n->right){
+    for(n = n->right; n->left; n = n->left)
+      ;
+    return n;
+  }
+  while(n->parent && n == n->parent->right)
+    n = n->parent;
+  return n->parent;
+}
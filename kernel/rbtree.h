@@ -0,0 +1,17 @@
+#pragma once
+
+// intrusive red-black tree; see rbtree.c.
+struct rbnode {
+  struct rbnode *parent;
+  struct rbnode *left;
+  struct rbnode *right;
+  int red;
+};
+
+struct rbtree {
+  struct rbnode *root;
+};
+
+// the structure of type type whose member member is node n.
+#define RBENTRY(n, type, member) \
+  ((type *)((char *)(n) - (uint64)&((type *)0)->member))
@@ -42,6 +42,14 @@ w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_SUM (1L << 18) // Supervisor may access User memory
+#define SSTATUS_FS (3L << 13)  // floating-point unit state:
+#define SSTATUS_FS_OFF (0L << 13)   //   FP instructions trap
+#define SSTATUS_FS_CLEAN (2L << 13) //   registers match the saved copy
+#define SSTATUS_FS_DIRTY (3L << 13) //   registers changed since then
+#define SSTATUS_VS (3L << 9)   // vector unit state, encoded like FS
+#define SSTATUS_VS_CLEAN (2L << 9)
+#define SSTATUS_VS_DIRTY (3L << 9)
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -78,6 +86,15 @@ w_sip(uint64 x)
 }
 
 // Supervisor Interrupt Enable
+// vector register length in bytes.
+static inline uint64
+r_vlenb()
+{
+  uint64 x;
+  asm volatile("csrr %0, 0xc22" : "=r" (x) );
+  return x;
+}
+
 #define SIE_SEIE (1L << 9) // external
 #define SIE_STIE (1L << 5) // timer
 #define SIE_SSIE (1L << 1) // software
@@ -97,6 +114,7 @@ w_sie(uint64 x)
 
 // Machine-mode Interrupt Enable
 #define MIE_STIE (1L << 5)  // supervisor timer
+#define MIE_MSIE (1L << 3)  // machine software
 static inline uint64
 r_mie()
 {
@@ -111,6 +129,19 @@ w_mie(uint64 x)
   asm volatile("csrw mie, %0" : : "r" (x));
 }
 
+// Machine-mode interrupt vector
+static inline void 
+w_mtvec(uint64 x)
+{
+  asm volatile("csrw mtvec, %0" : : "r" (x));
+}
+
+static inline void 
+w_mscratch(uint64 x)
+{
+  asm volatile("csrw mscratch, %0" : : "r" (x));
+}
+
 // supervisor exception program counter, holds the
 // instruction address to which a return from
 // exception will go.
@@ -275,6 +306,21 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor Counter-Enable: the counters U-mode may read.
+static inline void
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -284,6 +330,15 @@ r_time()
   return x;
 }
 
+// cycle counter
+static inline uint64
+r_cycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, cycle" : "=r" (x) );
+  return x;
+}
+
 // enable device interrupts
 static inline void
 intr_on()
@@ -362,6 +417,7 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_COW (1L << 8) // copy-on-write page (RSW bit)
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,1160 @@
+//
+// per-CPU run queues, and the scheduling policy.
+//
+// every RUNNABLE process sits on exactly one CPU's run queue,
+// or on its throttled group's held list.
+// setrunnable() puts a process on the queue of the CPU it last
+// ran on, whose caches may still hold its data, unless that
+// CPU is busier than this one. it kicks the CPU with a
+// software interrupt if that CPU is idle, or should preempt
+// what it is running for p; or, if the CPU is busy, kicks an
+// idle one to come and steal p. scheduler() takes processes
+// from its own CPU's queue, and steals from the busiest other
+// CPU when that evens out their loads. a CPU's load is the
+// total weight (see below) of its runnable processes.
+//
+// the policy is a multi-level feedback queue. a run queue has
+// NLEVEL priority levels; level 0 runs first. a process that
+// uses up the quantum of its level moves down one (see
+// schedtick()), one that wakes up from sleep moves up one, and
+// every BOOSTTICKS ticks all processes go back to level 0, so
+// that processes that have become interactive again, or are
+// starving behind interactive ones, get a fresh start.
+//
+// the upper levels are FIFO. the bottom level, where CPU-bound
+// processes end up, is weighted fair: every process has a nice
+// value, and so a weight, and is charged virtual runtime, its
+// real run time divided by its weight, at every level. the
+// bottom level is a red-black tree ordered by virtual runtime
+// and runs the process that is furthest behind, so CPU-bound
+// processes get the CPU in proportion to their weights.
+//
+// processes in the earliest-deadline-first (EDF) class, set up
+// by schedsetdl(), come before all others. each asks for some
+// runtime in every period, by some deadline after the start of
+// the period. admission control assigns each to a CPU with
+// that much bandwidth left, and it only ever runs there. a run
+// queue keeps them in a red-black tree by absolute deadline.
+// an EDF process that uses up its runtime, which a per-CPU
+// budget timer catches as it happens, or declares its job
+// done with schedyield(), is throttled until its next period
+// starts; see replenish().
+//
+// processes can be put in groups that share a CPU quota per
+// period (see groupcreate()). a CPU that runs one of a group's
+// processes takes a slice of the quota up front (grant()), so
+// that CPUs running the group together can't overspend it, and
+// gives back what the process didn't use when it stops
+// (schedstop()). a per-CPU timer interrupts a process when its
+// slice runs out, and once the quota has, the group's
+// processes wait on the group instead of a run queue until the
+// next period starts. EDF processes are exempt.
+//
+// a process runs only on the CPUs in its affinity mask:
+// setrunnable() and steal() leave the others alone.
+//
+// lock order: p->lock, then a run queue lock. scheduler()
+// takes a process off a queue before it acquires p->lock; p
+// may still be on its way out of another CPU, which releases
+// p->lock only after swtch() has saved p's registers.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sched.h"
+#include "defs.h"
+
+#define QUANTUM(level) (1 << (level))  // in clock ticks
+#define BOOSTTICKS     30
+#define FAIR           (NLEVEL-1)      // the weighted fair level
+#define NICE0          1024            // weight of nice 0
+#define STEALSCAN      16              // queued processes steal() considers
+#define DLBWSHIFT      20              // fixed point for runtime/period
+#define DLBWMAX        ((95L << DLBWSHIFT) / 100)  // EDF share of a CPU
+#define DLMAXPERIOD    10000000        // microseconds
+#define GRANT          (timebase / 100)  // group quota taken at a time
+
+// may p run on CPU c?
+#define ALLOWED(p, c) (((p)->affinity >> ((c) - cpus)) & 1)
+
+// how far behind the slowest process on the queue a waking
+// sleeper may be, in virtual runtime: a bottom-level quantum.
+#define SLEEPCREDIT    ((uint64)QUANTUM(FAIR) * TICKTIME)
+
+// weight for each nice value from -20 to 19; each step is
+// about 1.25 times the CPU of the next.
+static const int niceweight[40] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+  9548, 7620, 6100, 4904, 3906,
+  3121, 2501, 1991, 1586, 1277,
+  1024, 820, 655, 526, 423,
+  335, 272, 215, 172, 137,
+  110, 87, 70, 56, 45,
+  36, 29, 23, 18, 15,
+};
+
+// protects the rq.dlbw fields.
+struct spinlock dllock;
+
+// a group of processes sharing a CPU quota.
+// groups[0] stands for no group, and is never used.
+struct group {
+  struct spinlock lock;
+  int refs;             // processes in it, 0 if free; grouplock
+  uint64 quota;         // r_time() of CPU per period
+  uint64 period;
+  uint64 start;         // of the current period
+  uint64 used;          // in the current period
+  uint64 total;         // since it was created
+  int nthrottled;       // periods in which it ran out
+  int creator;          // pid of the process that made it
+  int throttled;        // out of quota in this period?
+  struct proc *held;    // processes waiting for the next period
+  struct timer timer;   // start of the next period, if throttled
+} groups[NGROUP];
+
+// protects group refs.
+struct spinlock grouplock;
+
+static void unthrottle(void *);
+static void regroup(struct proc *, int);
+
+void
+runqinit(void)
+{
+  initlock(&dllock, "dl");
+  initlock(&grouplock, "groups");
+  for(int i = 0; i < NGROUP; i++){
+    initlock(&groups[i].lock, "group");
+    inittimer(&groups[i].timer, unthrottle, &groups[i]);
+  }
+  for(int i = 0; i < ncpu; i++){
+    initlock(&cpus[i].rq.lock, "runq");
+    // its expiry interrupts the CPU, and schedtick() or
+    // scheduler() calls replenish().
+    inittimer(&cpus[i].rq.dltimer, 0, 0);
+    inittimer(&cpus[i].quota, 0, 0);
+    inittimer(&cpus[i].budget, 0, 0);
+  }
+}
+
+// which boost period this is.
+static uint
+epoch(void)
+{
+  return r_time() / (BOOSTTICKS * TICKTIME);
+}
+
+// p's level, putting it back at the top if there has been a
+// boost since it last looked. p must be running, or p->lock
+// held.
+static int
+level(struct proc *p)
+{
+  uint e = epoch();
+
+  if(p->epoch != e){
+    p->epoch = e;
+    p->level = 0;
+    p->slice = 0;
+  }
+  return p->level;
+}
+
+// c's load: the weights of its queued processes and of the
+// one it is running. a hint.
+static uint64
+load(struct cpu *c)
+{
+  return c->rq.load + c->rq.curload;
+}
+
+static int
+vrless(struct rbnode *a, struct rbnode *b)
+{
+  struct proc *p = RBENTRY(a, struct proc, rbnode);
+  struct proc *q = RBENTRY(b, struct proc, rbnode);
+
+  return (long)(p->vruntime - q->vruntime) < 0;
+}
+
+static int
+dlless(struct rbnode *a, struct rbnode *b)
+{
+  struct proc *p = RBENTRY(a, struct proc, rbnode);
+  struct proc *q = RBENTRY(b, struct proc, rbnode);
+
+  return (long)(p->dlabs - q->dlabs) < 0;
+}
+
+// start a new EDF job for p at time start.
+static void
+newjob(struct proc *p, uint64 start)
+{
+  p->dlabs = start + p->dldeadline;
+  p->dlnext = start + p->dlperiod;
+  p->dlbudget = p->dlruntime;
+  p->dldone = 0;
+}
+
+// move the throttled EDF processes on rq whose next period
+// has started into the deadline tree, with fresh runtime.
+// a job that wasn't done by its deadline is a miss. runtime
+// a process overran by comes out of its next jobs, and it
+// stays throttled until it has paid that back.
+// rq->lock must be held.
+static void
+replenish(struct runq *rq)
+{
+  struct proc **pp, *p;
+  uint64 now = r_time();
+  long debt;
+
+  for(pp = &rq->dlthrottled; (p = *pp) != 0; ){
+    if((long)(now - p->dlnext) < 0){
+      pp = &p->rqnext;
+      continue;
+    }
+    if(!p->dldone && (long)(now - p->dlabs) > 0)
+      p->dlmisses++;
+    // skip the periods it overran completely.
+    if((long)(now - (p->dlnext + p->dlperiod)) >= 0)
+      p->dlnext = now;
+    debt = p->dlbudget < 0 ? p->dlbudget : 0;
+    newjob(p, p->dlnext);
+    p->dlbudget += debt;
+    if(p->dlbudget <= 0){
+      // a job that only pays back isn't a miss.
+      p->dldone = 1;
+      pp = &p->rqnext;
+      continue;
+    }
+    *pp = p->rqnext;
+    p->rqnext = 0;
+    rb_insert(&rq->dl, &p->rbnode, dlless);
+  }
+}
+
+// set rq's timer for when the first of its throttled EDF
+// processes gets fresh runtime. rq must be this CPU's, and
+// rq->lock held.
+static void
+dlarm(struct runq *rq)
+{
+  struct proc *p;
+  uint64 when;
+
+  if((p = rq->dlthrottled) == 0)
+    return;
+  when = p->dlnext;
+  for(; p; p = p->rqnext)
+    if((long)(p->dlnext - when) < 0)
+      when = p->dlnext;
+  if(!timerpending(&rq->dltimer) || rq->dltimer.when != when)
+    settimer(&rq->dltimer, when);
+}
+
+// the EDF process with the earliest deadline on rq, taken
+// off it, if any. rq->lock must be held.
+static struct proc*
+dlpick(struct runq *rq)
+{
+  struct rbnode *n;
+
+  replenish(rq);
+  if((n = rb_first(&rq->dl)) == 0)
+    return 0;
+  rb_erase(&rq->dl, n);
+  return RBENTRY(n, struct proc, rbnode);
+}
+
+// advance rq->minvruntime, which only ever grows, to the
+// smallest virtual runtime on rq or of p, which is about to
+// run or running here. rq->lock must be held.
+static void
+updatemin(struct runq *rq, struct proc *p)
+{
+  struct rbnode *n = rb_first(&rq->fair);
+  uint64 v = p->vruntime;
+
+  if(n && vrless(n, &p->rbnode))
+    v = RBENTRY(n, struct proc, rbnode)->vruntime;
+  if((long)(v - rq->minvruntime) > 0)
+    rq->minvruntime = v;
+}
+
+// add p to rq at p->level, or to rq's EDF processes.
+// rq->lock must be held.
+static void
+enqueue(struct runq *rq, struct proc *p)
+{
+  int l = p->level;
+
+  // EDF processes don't count towards n or load;
+  // steal() can't move them.
+  if(p->dlperiod){
+    if(p->dlbudget <= 0){
+      p->rqnext = rq->dlthrottled;
+      rq->dlthrottled = p;
+    } else {
+      rb_insert(&rq->dl, &p->rbnode, dlless);
+    }
+    return;
+  }
+  rq->n++;
+  rq->load += p->weight;
+  if(l == FAIR){
+    rb_insert(&rq->fair, &p->rbnode, vrless);
+    return;
+  }
+  p->rqnext = 0;
+  if(rq->tail[l])
+    rq->tail[l]->rqnext = p;
+  else
+    rq->head[l] = p;
+  rq->tail[l] = p;
+}
+
+// take p, which is on one of rq's levels, off it.
+// rq->lock must be held.
+static void
+unqueue(struct runq *rq, struct proc *p)
+{
+  struct proc **pp, *prev = 0;
+  int l = p->level;
+
+  if(rq->handoff == p)
+    rq->handoff = 0;
+  rq->n--;
+  rq->load -= p->weight;
+  if(l == FAIR){
+    rb_erase(&rq->fair, &p->rbnode);
+    return;
+  }
+  for(pp = &rq->head[l]; *pp != p; pp = &(*pp)->rqnext)
+    prev = *pp;
+  *pp = p->rqnext;
+  if(rq->tail[l] == p)
+    rq->tail[l] = prev;
+  p->rqnext = 0;
+}
+
+// move everything on rq to level 0 once per boost period,
+// keeping the order, and the bottom level's processes in
+// virtual runtime order after the rest. rq->lock must be held.
+static void
+boost(struct runq *rq)
+{
+  struct rbnode *n;
+  struct proc *p;
+  uint e = epoch();
+
+  if(rq->epoch == e)
+    return;
+  rq->epoch = e;
+  for(int l = 1; l < FAIR; l++){
+    for(p = rq->head[l]; p; p = p->rqnext)
+      p->level = 0;
+    if(rq->head[l] == 0)
+      continue;
+    if(rq->tail[0])
+      rq->tail[0]->rqnext = rq->head[l];
+    else
+      rq->head[0] = rq->head[l];
+    rq->tail[0] = rq->tail[l];
+    rq->head[l] = rq->tail[l] = 0;
+  }
+  // the tree's nodes can simply be abandoned.
+  for(n = rb_first(&rq->fair); n; n = rb_next(n)){
+    p = RBENTRY(n, struct proc, rbnode);
+    p->level = 0;
+    p->rqnext = 0;
+    if(rq->tail[0])
+      rq->tail[0]->rqnext = p;
+    else
+      rq->head[0] = p;
+    rq->tail[0] = p;
+  }
+  rq->fair.root = 0;
+  for(p = rq->head[0]; p; p = p->rqnext){
+    p->epoch = e;
+    p->slice = 0;
+  }
+}
+
+// take the process that should run next off rq, if any.
+// rq->lock must be held.
+static struct proc*
+dequeue(struct runq *rq)
+{
+  struct rbnode *n;
+  struct proc *p;
+
+  if((p = dlpick(rq)) != 0)
+    return p;
+  boost(rq);
+  for(int l = 0; l < FAIR; l++){
+    if((p = rq->head[l]) != 0){
+      unqueue(rq, p);
+      return p;
+    }
+  }
+  if((n = rb_first(&rq->fair)) != 0){
+    p = RBENTRY(n, struct proc, rbnode);
+    unqueue(rq, p);
+    updatemin(rq, p);
+    return p;
+  }
+  return 0;
+}
+
+// the CPU whose queue p should join.
+// interrupts must be disabled.
+static struct cpu*
+placecpu(struct proc *p)
+{
+  struct cpu *me = mycpu();
+  struct cpu *c, *best = 0;
+
+  if(p->dlperiod)
+    return &cpus[p->dlcpu];
+  if(p->cpu >= 0 && ALLOWED(p, &cpus[p->cpu])){
+    c = &cpus[p->cpu];
+    if(c == me || !ALLOWED(p, me) || load(c) == 0)
+      return c;
+    if(load(c) > load(me))
+      return me;
+    return c;
+  }
+  if(ALLOWED(p, me))
+    return me;
+  // the least loaded CPU it may run on.
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    if(ALLOWED(p, c) && (best == 0 || load(c) < load(best)))
+      best = c;
+  }
+  return best;
+}
+
+static int
+prio(struct proc *p)
+{
+  return p->dlperiod ? -1 : p->level;
+}
+
+// p has just joined c's queue. kick c if it is idle, or if p
+// should preempt what it is running; otherwise kick an idle CPU
+// that may run p, to steal it. c->idle is set before c looks
+// at its queue, so either c sees p, or we see c->idle.
+static void
+notify(struct cpu *c, struct proc *p)
+{
+  struct cpu *me = mycpu(), *i;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(c->idle || prio(p) < c->rq.curprio){
+    if(c != me)
+      kickcpu(c);
+    return;
+  }
+  if(p->dlperiod)
+    return;
+  for(i = cpus; i < &cpus[ncpu]; i++){
+    if(i != me && i != c && i->idle && ALLOWED(p, i)){
+      kickcpu(i);
+      return;
+    }
+  }
+}
+
+// Set up the scheduling state of np, a new process, which
+// inherits its nice value and virtual runtime from parent,
+// if there is one.
+void
+schedinit(struct proc *np, struct proc *parent)
+{
+  np->cpu = -1;
+  np->affinity = parent ? parent->affinity : ~0UL;
+  np->level = 0;
+  np->slice = 0;
+  np->nice = parent ? parent->nice : 0;
+  np->weight = niceweight[np->nice + 20];
+  np->vruntime = parent ? parent->vruntime : 0;
+  np->dlperiod = 0;
+  np->dlbw = 0;
+  np->dlmisses = 0;
+  np->grant = 0;
+  acquire(&grouplock);
+  np->group = 0;
+  if(parent)
+    regroup(np, parent->group);
+  release(&grouplock);
+}
+
+// p, an EDF process, is waking up. if it can't finish what is
+// left of its runtime by its deadline at its reserved rate,
+// which includes the deadline having passed, start a new job
+// now, so that it can't take more than its share.
+static void
+dlwake(struct proc *p)
+{
+  uint64 now = r_time();
+
+  if(p->dlbudget <= 0)
+    return;  // replenish() will see to it
+  if((long)(now - p->dlabs) >= 0 ||
+     p->dlbudget * p->dlperiod > (p->dlabs - now) * p->dlruntime){
+    if(!p->dldone && (long)(now - p->dlabs) > 0)
+      p->dlmisses++;
+    newjob(p, now);
+  }
+}
+
+// start a new period for g if the current one is over.
+// g->lock must be held.
+static void
+newperiod(struct group *g)
+{
+  uint64 now = r_time();
+
+  if(now - g->start >= g->period){
+    g->start = now;
+    g->used = 0;
+  }
+}
+
+// if p's group is out of quota, hold p, which is RUNNABLE,
+// on the group until its next period. returns 1 if it did.
+// p->lock must be held.
+static int
+throttle(struct proc *p)
+{
+  struct group *g = &groups[p->group];
+
+  if(p->group == 0 || p->dlperiod)
+    return 0;
+  acquire(&g->lock);
+  newperiod(g);
+  if(g->used < g->quota){
+    release(&g->lock);
+    return 0;
+  }
+  if(!g->throttled){
+    g->throttled = 1;
+    g->nthrottled++;
+    settimer(&g->timer, g->start + g->period);
+  }
+  p->rqnext = g->held;
+  g->held = p;
+  release(&g->lock);
+  return 1;
+}
+
+// g's next period has started: put its held processes back
+// on run queues. a timer function.
+static void
+unthrottle(void *arg)
+{
+  struct group *g = arg;
+  struct proc *p, *next;
+
+  acquire(&g->lock);
+  newperiod(g);
+  g->throttled = 0;
+  p = g->held;
+  g->held = 0;
+  release(&g->lock);
+  for(; p; p = next){
+    next = p->rqnext;
+    acquire(&p->lock);
+    setrunnable(p);
+    release(&p->lock);
+  }
+}
+
+// mark p RUNNABLE and put it on a run queue, this CPU's as
+// the next to run if handoff is set; see schedhandoff().
+static void
+ready(struct proc *p, int handoff)
+{
+  struct cpu *c;
+  uint64 min;
+  int wake;
+
+  if(!holding(&p->lock))
+    panic("setrunnable");
+  // charge it now; once it's on a queue, another CPU may
+  // take it, and sched() leaves it alone.
+  if(p->state == RUNNING)
+    schedstop(p);
+  wake = p->state == SLEEPING;
+  if(p->dlperiod && wake)
+    dlwake(p);
+  if(level(p) > 0 && wake){
+    p->level--;
+    p->slice = 0;
+  }
+  p->state = RUNNABLE;
+  if(throttle(p))
+    return;
+  if(handoff && !p->dlperiod && ALLOWED(p, mycpu())){
+    c = mycpu();
+  } else {
+    handoff = 0;
+    c = placecpu(p);
+  }
+
+  acquire(&c->rq.lock);
+  // p's virtual runtime is relative to its last CPU's.
+  if(p->cpu >= 0 && c != &cpus[p->cpu])
+    p->vruntime += c->rq.minvruntime - cpus[p->cpu].rq.minvruntime;
+  // don't let a long sleep turn into a long monopoly.
+  min = c->rq.minvruntime - SLEEPCREDIT;
+  if(wake && (long)(p->vruntime - min) < 0)
+    p->vruntime = min;
+  enqueue(&c->rq, p);
+  if(handoff)
+    c->rq.handoff = p;
+  release(&c->rq.lock);
+  if(!handoff)
+    notify(c, p);
+}
+
+// Mark p RUNNABLE and put it on a run queue.
+// A process waking up from sleep moves up a level.
+// Caller must hold p->lock.
+void
+setrunnable(struct proc *p)
+{
+  ready(p, 0);
+}
+
+// Like setrunnable(), for p, a sleeping process that the
+// current process is waking up just before it blocks itself,
+// as in a request and response over a pipe. Queue p on this
+// CPU, without kicking any other, and run it next here when
+// the current process gives up the CPU, unless an EDF process
+// is waiting. Caller must hold p->lock.
+void
+schedhandoff(struct proc *p)
+{
+  ready(p, 1);
+}
+
+// The current process is going back to user space instead of
+// blocking. If it handed a process this CPU with
+// schedhandoff(), that one mustn't wait behind it: treat it
+// as setrunnable() would, kicking an idle CPU to take it.
+// Interrupts must be disabled.
+void
+schedunhandoff(void)
+{
+  struct cpu *c = mycpu();
+
+  if(c->rq.handoff == 0)
+    return;
+  acquire(&c->rq.lock);
+  // still queued here while rq->lock is held.
+  if(c->rq.handoff){
+    notify(c, c->rq.handoff);
+    c->rq.handoff = 0;
+  }
+  release(&c->rq.lock);
+}
+
+// Charge p, which is running, for its CPU time since it
+// was last charged. its group has been charged already for
+// as much of it as p's grant covers.
+static void
+schedcharge(struct proc *p)
+{
+  uint64 now = r_time(), ran = now - p->runstart;
+
+  p->vruntime += ran * NICE0 / p->weight;
+  if(p->dlperiod)
+    p->dlbudget -= ran;
+  if(p->group){
+    struct group *g = &groups[p->group];
+    acquire(&g->lock);
+    newperiod(g);
+    if(p->grantstart != g->start)
+      p->grant = 0;  // taken in a period that is over
+    if(ran > p->grant){
+      g->used += ran - p->grant;
+      p->grant = 0;
+    } else {
+      p->grant -= ran;
+    }
+    g->total += ran;
+    release(&g->lock);
+  }
+  p->runstart = now;
+}
+
+// give p's group back the part of p's grant it didn't use.
+static void
+ungrant(struct proc *p)
+{
+  struct group *g = &groups[p->group];
+
+  if(p->grant == 0)
+    return;
+  acquire(&g->lock);
+  if(p->grantstart == g->start)
+    g->used -= p->grant;
+  p->grant = 0;
+  release(&g->lock);
+}
+
+// p, which is running, is about to stop: charge it, and
+// give back what it didn't use of its group's quota.
+void
+schedstop(struct proc *p)
+{
+  schedcharge(p);
+  ungrant(p);
+}
+
+// charge p's group up front for a slice of its quota for p to
+// run on c, and set c's quota timer for when the slice runs
+// out. returns 0 if the group's quota is gone.
+// Interrupts must be disabled.
+static int
+grant(struct cpu *c, struct proc *p)
+{
+  struct group *g = &groups[p->group];
+  uint64 left;
+
+  acquire(&g->lock);
+  newperiod(g);
+  if(p->grantstart == g->start)
+    g->used -= p->grant;
+  left = g->used < g->quota ? g->quota - g->used : 0;
+  p->grant = left < GRANT ? left : GRANT;
+  p->grantstart = g->start;
+  g->used += p->grant;
+  release(&g->lock);
+  settimer(&c->quota, r_time() + p->grant);
+  return p->grant > 0;
+}
+
+// p is about to run on c. if it is an EDF process, set c's
+// budget timer for when its runtime would run out, so that
+// schedtick() throttles it then rather than at the next tick;
+// if it is in a group, take a slice of the group's quota.
+// Interrupts must be disabled.
+void
+schedquota(struct cpu *c, struct proc *p)
+{
+  if(p->dlperiod){
+    settimer(&c->budget, r_time() + (p->dlbudget > 0 ? p->dlbudget : 0));
+    return;
+  }
+  if(p->group)
+    grant(c, p);
+}
+
+// Called on timer interrupts with p, the process running on
+// this CPU. Charges p, and a clock tick if the CPU's slice
+// timer expired, which starts the next one.
+// Returns 1 if p should yield: an EDF process with an earlier
+// deadline is waiting, p is an EDF process out of runtime, p's
+// group is out of quota, or p has used up the quantum of its
+// level, which also moves it down one, or a process at a
+// higher level is waiting here.
+// Interrupts must be disabled.
+int
+schedtick(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  struct runq *rq = &c->rq;
+  struct rbnode *n;
+  int l, resched, tick;
+
+  tick = c->sliceout;
+  c->sliceout = 0;
+  if(tick)
+    settimer(&c->slice, r_time() + TICKTIME);
+  schedcharge(p);
+  acquire(&rq->lock);
+  replenish(rq);
+  n = rb_first(&rq->dl);
+  if(p->dlperiod || n){
+    resched = !p->dlperiod || p->dlbudget <= 0 || (n && dlless(n, &p->rbnode));
+    release(&rq->lock);
+    return resched;
+  }
+  l = level(p);
+  if(l == FAIR)
+    updatemin(rq, p);
+  release(&rq->lock);
+
+  // its slice of the group's quota is used up; take another.
+  if(p->group && p->grant == 0 && !grant(c, p))
+    return 1;
+
+  if(tick && ++p->slice >= QUANTUM(l)){
+    if(l < FAIR)
+      p->level++;
+    p->slice = 0;
+    return 1;
+  }
+  // a hint; the process will find out soon enough.
+  for(int i = 0; i < l && i < FAIR; i++)
+    if(rq->head[i])
+      return 1;
+  return 0;
+}
+
+// Add incr to the current process's nice value, keeping it
+// within [-20, 19], and return the new value.
+int
+nice(int incr)
+{
+  struct proc *p = myproc();
+  int v;
+
+  acquire(&p->lock);
+  v = p->nice + incr;
+  if(v < -20)
+    v = -20;
+  if(v > 19)
+    v = 19;
+  p->nice = v;
+  p->weight = niceweight[v + 20];
+  release(&p->lock);
+  return v;
+}
+
+// Give up the CPU for one scheduling round. An EDF process
+// also gives up the rest of this period's runtime: its job is
+// done.
+void
+schedyield(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+  if(p->dlperiod){
+    // charge it first, so that what it overran by stays owed.
+    schedcharge(p);
+    p->dldone = 1;
+    if(p->dlbudget > 0)
+      p->dlbudget = 0;
+  }
+  setrunnable(p);
+  sched();
+  release(&p->lock);
+}
+
+static uint64
+us2time(uint64 us)
+{
+  return us * timebase / 1000000;
+}
+
+static uint64
+time2us(uint64 t)
+{
+  return t * 1000000 / timebase;
+}
+
+// Put p, the current process, in the EDF class with runtime,
+// period and deadline in microseconds, or back in the normal
+// class if runtime is 0. It moves to its CPU when it next
+// yields. Returns -1 if the parameters make no sense, or no
+// CPU has enough bandwidth left.
+int
+schedsetdl(struct proc *p, uint64 runtime, uint64 period, uint64 deadline)
+{
+  struct cpu *c, *best = 0;
+  uint64 bw = 0;
+
+  if(runtime){
+    if(runtime > deadline || deadline > period || period > DLMAXPERIOD)
+      return -1;
+    bw = (runtime << DLBWSHIFT) / period;
+  }
+
+  acquire(&dllock);
+  if(p->dlperiod)
+    cpus[p->dlcpu].rq.dlbw -= p->dlbw;
+  if(runtime){
+    // the CPU with the most bandwidth left.
+    for(c = cpus; c < &cpus[ncpu]; c++){
+      if(ALLOWED(p, c) && c->rq.dlbw + bw <= DLBWMAX &&
+         (best == 0 || c->rq.dlbw < best->rq.dlbw))
+        best = c;
+    }
+    if(best == 0){
+      if(p->dlperiod)
+        cpus[p->dlcpu].rq.dlbw += p->dlbw;
+      release(&dllock);
+      return -1;
+    }
+    best->rq.dlbw += bw;
+  }
+  release(&dllock);
+
+  acquire(&p->lock);
+  p->dlbw = bw;
+  if(runtime){
+    p->dlruntime = us2time(runtime);
+    p->dlperiod = us2time(period);
+    p->dldeadline = us2time(deadline);
+    p->dlcpu = best - cpus;
+    p->dlmisses = 0;
+    newjob(p, r_time());
+  } else {
+    p->dlperiod = 0;
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Let p run only on the CPUs in mask, one bit per CPU.
+// An EDF process must keep the CPU it was admitted to.
+// Returns -1 if that leaves p nowhere to run.
+// Caller must hold p->lock.
+int
+schedsetaffinity(struct proc *p, uint64 mask)
+{
+  if(ncpu < 64)
+    mask &= (1UL << ncpu) - 1;
+  if(mask == 0)
+    return -1;
+  if(p->dlperiod && ((mask >> p->dlcpu) & 1) == 0)
+    return -1;
+  p->affinity = mask;
+  return 0;
+}
+
+// Fill in *a with p's EDF parameters.
+void
+schedgetdl(struct proc *p, struct sched_attr *a)
+{
+  acquire(&p->lock);
+  if(p->dlperiod){
+    a->runtime = time2us(p->dlruntime);
+    a->period = time2us(p->dlperiod);
+    a->deadline = time2us(p->dldeadline);
+  } else {
+    a->runtime = a->period = a->deadline = 0;
+  }
+  a->misses = p->dlmisses;
+  release(&p->lock);
+}
+
+// the other CPU with the highest load, or 0 if
+// none has anything queued.
+static struct cpu*
+busiest(struct cpu *me)
+{
+  struct cpu *c, *b = 0;
+
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    if(c != me && c->rq.n > 0 && (b == 0 || load(c) > load(b)))
+      b = c;
+  }
+  return b;
+}
+
+static uint64
+distance(uint64 a, uint64 b)
+{
+  return a > b ? a - b : b - a;
+}
+
+// Take a process off from's queue for c to run, if moving
+// one shrinks the difference diff between their loads.
+// Picks the one that leaves them closest.
+static struct proc*
+steal(struct cpu *from, struct cpu *c, uint64 diff)
+{
+  struct runq *rq = &from->rq;
+  struct proc *p, *best = 0;
+  struct rbnode *n;
+  int scan = 0;
+
+  acquire(&rq->lock);
+  for(int l = 0; l < NLEVEL; l++){
+    n = l == FAIR ? rb_first(&rq->fair) : 0;
+    p = l == FAIR ? (n ? RBENTRY(n, struct proc, rbnode) : 0) : rq->head[l];
+    while(p && scan++ < STEALSCAN){
+      if(p->weight < diff && ALLOWED(p, c) && (best == 0 ||
+         distance(diff, 2*p->weight) < distance(diff, 2*best->weight)))
+        best = p;
+      if(l == FAIR){
+        n = rb_next(n);
+        p = n ? RBENTRY(n, struct proc, rbnode) : 0;
+      } else {
+        p = p->rqnext;
+      }
+    }
+  }
+  if(best){
+    unqueue(rq, best);
+    best->vruntime += c->rq.minvruntime - rq->minvruntime;
+  }
+  release(&rq->lock);
+  return best;
+}
+
+// Choose a process for c to run next, and take it off its run
+// queue. The caller must then acquire p->lock; see above.
+// Returns 0 if there is nothing to run.
+struct proc*
+runqpick(struct cpu *c)
+{
+  struct cpu *b;
+  struct proc *p = 0;
+
+  c->rq.curload = 0;
+  c->rq.curprio = NLEVEL;
+  // a process that the last one to run here woke up
+  // just before blocking.
+  if(c->rq.handoff){
+    acquire(&c->rq.lock);
+    if((p = c->rq.handoff) != 0 && rb_first(&c->rq.dl) == 0)
+      unqueue(&c->rq, p);
+    else
+      p = 0;
+    c->rq.handoff = 0;
+    release(&c->rq.lock);
+  }
+  if(p == 0 && (b = busiest(c)) != 0 && load(b) > load(c))
+    p = steal(b, c, load(b) - load(c));
+  if(p == 0){
+    acquire(&c->rq.lock);
+    p = dequeue(&c->rq);
+    release(&c->rq.lock);
+  }
+  if(p){
+    c->rq.curload = p->weight;
+    c->rq.curprio = prio(p);
+  }
+  if(c->rq.dlthrottled){
+    acquire(&c->rq.lock);
+    dlarm(&c->rq);
+    release(&c->rq.lock);
+  }
+  return p;
+}
+
+// move p from its group into group gid, freeing the old
+// group if p was its last process. grouplock must be held.
+static void
+regroup(struct proc *p, int gid)
+{
+  if(gid != 0)
+    groups[gid].refs++;
+  ungrant(p);
+  if(p->group != 0 && --groups[p->group].refs == 0)
+    canceltimer(&groups[p->group].timer);
+  p->group = gid;
+}
+
+// may p leave its group? only the process that made a group
+// may; the rest, its children, are held to its quota.
+// grouplock must be held.
+static int
+mayleave(struct proc *p)
+{
+  return p->group == 0 || groups[p->group].creator == p->pid;
+}
+
+// Make a new group with quota microseconds of CPU time per
+// period, which may be more than period on a multiprocessor,
+// and move p into it. Returns the group's id, or -1.
+int
+groupcreate(struct proc *p, uint64 quota, uint64 period)
+{
+  struct group *g;
+
+  if(quota == 0 || period == 0 || period > DLMAXPERIOD)
+    return -1;
+  acquire(&grouplock);
+  if(!mayleave(p)){
+    release(&grouplock);
+    return -1;
+  }
+  for(g = &groups[1]; g < &groups[NGROUP]; g++){
+    if(g->refs == 0){
+      acquire(&g->lock);
+      g->quota = us2time(quota);
+      g->period = us2time(period);
+      g->start = r_time();
+      g->used = g->total = 0;
+      g->nthrottled = 0;
+      g->creator = p->pid;
+      g->throttled = 0;
+      g->held = 0;
+      release(&g->lock);
+      regroup(p, g - groups);
+      release(&grouplock);
+      return g - groups;
+    }
+  }
+  release(&grouplock);
+  return -1;
+}
+
+// Move p, the current process, into group gid; 0 takes it out
+// of any group. Returns -1 if there is no such group, or p may
+// not leave the one it is in.
+int
+groupjoin(struct proc *p, int gid)
+{
+  if(gid < 0 || gid >= NGROUP)
+    return -1;
+  acquire(&grouplock);
+  if((gid != 0 && groups[gid].refs == 0) ||
+     (gid != p->group && !mayleave(p))){
+    release(&grouplock);
+    return -1;
+  }
+  regroup(p, gid);
+  release(&grouplock);
+  return 0;
+}
+
+// Take p, a process being freed, out of its group. A group
+// with no processes left is free.
+void
+groupexit(struct proc *p)
+{
+  acquire(&grouplock);
+  regroup(p, 0);
+  release(&grouplock);
+}
+
+// Fill in *st with group gid's usage.
+// Returns -1 if there is no such group.
+int
+groupstat(int gid, struct groupstat *st)
+{
+  struct group *g;
+
+  if(gid <= 0 || gid >= NGROUP)
+    return -1;
+  g = &groups[gid];
+  acquire(&grouplock);
+  if(g->refs == 0){
+    release(&grouplock);
+    return -1;
+  }
+  st->nproc = g->refs;
+  acquire(&g->lock);
+  st->usage = time2us(g->total);
+  st->quota = time2us(g->quota);
+  st->period = time2us(g->period);
+  st->throttled = g->nthrottled;
+  release(&g->lock);
+  release(&grouplock);
+  return 0;
+}
@@ -0,0 +1,17 @@
+// for sched_setattr() and sched_getattr(). times are in
+// microseconds.
+struct sched_attr {
+  int runtime;    // CPU time per period; 0 for the normal class
+  int period;
+  int deadline;   // after the start of each period
+  int misses;     // deadlines missed; sched_getattr() only
+};
+
+// for groupstat(). times are in microseconds.
+struct groupstat {
+  uint64 usage;   // CPU time used by the group's processes
+  int quota;      // CPU time allowed per period
+  int period;
+  int throttled;  // periods in which it ran out of quota
+  int nproc;      // processes in the group
+};
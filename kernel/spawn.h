@@ -0,0 +1,12 @@
+// file actions for spawn(), applied in order to the child's
+// copy of the parent's open files.
+#define SPAWN_CLOSE  1  // close fd
+#define SPAWN_DUP2   2  // make newfd refer to fd's file, like dup2()
+
+#define NSPAWNACT   16  // maximum actions per spawn()
+
+struct spawnact {
+  int op;
+  int fd;
+  int newfd;
+};
@@ -6,14 +6,28 @@
 
 void main();
 void timerinit();
+void ipiinit();
+
+// in kernelvec.S.
+void machinevec();
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
-// entry.S jumps here in machine mode on stack0.
+// scratch area for machinevec, per CPU: [0] saves a
+// register, [1] is the address of the CPU's msip.
+uint64 mscratch0[NCPU][2];
+
+// entry.S jumps here in machine mode on stack0,
+// with the address of the device tree that qemu
+// passes in a1.
 void
-start()
+start(uint64 hartid, uint64 dtb)
 {
+  // main() reads the machine's RAM size and hart count from it.
+  if(r_mhartid() == 0)
+    dtbpa = dtb;
+
   // set M Previous Privilege mode to Supervisor, for mret.
   unsigned long x = r_mstatus();
   x &= ~MSTATUS_MPP_MASK;
@@ -40,6 +54,9 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // let other harts kick this one.
+  ipiinit();
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -58,9 +75,23 @@ timerinit()
   // enable the sstc extension (i.e. stimecmp).
   w_menvcfg(r_menvcfg() | (1L << 63)); 
   
-  // allow supervisor to use stimecmp and time.
-  w_mcounteren(r_mcounteren() | 2);
+  // allow supervisor to use stimecmp, time and cycle.
+  w_mcounteren(r_mcounteren() | 2 | 1);
   
-  // ask for the very first timer interrupt.
-  w_stimecmp(r_time() + 1000000);
+  // no timer interrupts until the kernel sets a timer.
+  w_stimecmp(~0UL);
+}
+
+// take the machine-mode software interrupts that other harts
+// raise through the CLINT to kick this one. machinevec passes
+// them on to supervisor mode.
+void
+ipiinit()
+{
+  int id = r_mhartid();
+
+  mscratch0[id][1] = CLINT_MSIP(id);
+  w_mscratch((uint64)mscratch0[id]);
+  w_mtvec((uint64)machinevec);
+  w_mie(r_mie() | MIE_MSIE);
 }
@@ -1,13 +1,43 @@
 #include "types.h"
 
+// the word-at-a-time loops below move 8 bytes per load or
+// store, 32 per iteration while there are enough, once the
+// pointers are 8-byte aligned. RISC-V may trap on (or
+// emulate slowly) misaligned accesses, so unaligned heads and
+// tails, and buffers that can't both be aligned, go a byte
+// at a time.
+
+#define WSIZE sizeof(uint64)
+#define WMASK (WSIZE - 1)
+#define ONES  0x0101010101010101UL
+#define HIGHS 0x8080808080808080UL
+
+// nonzero if one of the bytes of x is zero.
+#define HASZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 *w, x;
+
+  for(; n > 0 && ((uint64)cdst & WMASK); n--)
+    *cdst++ = c;
+
+  x = (uchar)c * ONES;
+  w = (uint64 *) cdst;
+  for(; n >= 4*WSIZE; n -= 4*WSIZE, w += 4){
+    w[0] = x;
+    w[1] = x;
+    w[2] = x;
+    w[3] = x;
   }
+  for(; n >= WSIZE; n -= WSIZE)
+    *w++ = x;
+
+  cdst = (char *) w;
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -18,6 +48,15 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if((((uint64)s1 ^ (uint64)s2) & WMASK) == 0){
+    for(; n > 0 && ((uint64)s1 & WMASK); n--, s1++, s2++)
+      if(*s1 != *s2)
+        return *s1 - *s2;
+    // skip equal words; the bytes find the difference.
+    for(; n >= WSIZE; n -= WSIZE, s1 += WSIZE, s2 += WSIZE)
+      if(*(uint64 *)s1 != *(uint64 *)s2)
+        break;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -32,20 +71,52 @@ memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  int aligned;
 
   if(n == 0)
     return dst;
   
   s = src;
   d = dst;
+  aligned = (((uint64)s ^ (uint64)d) & WMASK) == 0;
   if(s < d && s + n > d){
     s += n;
     d += n;
+    if(aligned){
+      for(; n > 0 && ((uint64)d & WMASK); n--)
+        *--d = *--s;
+      for(; n >= 4*WSIZE; n -= 4*WSIZE){
+        s -= 4*WSIZE;
+        d -= 4*WSIZE;
+        ((uint64 *)d)[3] = ((uint64 *)s)[3];
+        ((uint64 *)d)[2] = ((uint64 *)s)[2];
+        ((uint64 *)d)[1] = ((uint64 *)s)[1];
+        ((uint64 *)d)[0] = ((uint64 *)s)[0];
+      }
+      for(; n >= WSIZE; n -= WSIZE){
+        s -= WSIZE;
+        d -= WSIZE;
+        *(uint64 *)d = *(uint64 *)s;
+      }
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    if(aligned){
+      for(; n > 0 && ((uint64)d & WMASK); n--)
+        *d++ = *s++;
+      for(; n >= 4*WSIZE; n -= 4*WSIZE, s += 4*WSIZE, d += 4*WSIZE){
+        ((uint64 *)d)[0] = ((uint64 *)s)[0];
+        ((uint64 *)d)[1] = ((uint64 *)s)[1];
+        ((uint64 *)d)[2] = ((uint64 *)s)[2];
+        ((uint64 *)d)[3] = ((uint64 *)s)[3];
+      }
+      for(; n >= WSIZE; n -= WSIZE, s += WSIZE, d += WSIZE)
+        *(uint64 *)d = *(uint64 *)s;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
@@ -95,13 +166,41 @@ safestrcpy(char *s, const char *t, int n)
   return os;
 }
 
+// the word loops in strlen() and strnlen() read whole aligned
+// words, which may run past the terminating NUL but never
+// into another page.
+
 int
 strlen(const char *s)
 {
-  int n;
+  const char *p;
+  const uint64 *w;
 
-  for(n = 0; s[n]; n++)
+  for(p = s; (uint64)p & WMASK; p++)
+    if(*p == 0)
+      return p - s;
+  for(w = (const uint64 *)p; !HASZERO(*w); w++)
+    ;
+  for(p = (const char *)w; *p; p++)
     ;
-  return n;
+  return p - s;
 }
 
+// Length of s, or n if s has no NUL in its first n bytes.
+uint
+strnlen(const char *s, uint n)
+{
+  const char *p, *e;
+  const uint64 *w;
+
+  p = s;
+  e = s + n;
+  for(; p < e && ((uint64)p & WMASK); p++)
+    if(*p == 0)
+      return p - s;
+  for(w = (const uint64 *)p; (const char *)w + WSIZE <= e && !HASZERO(*w); w++)
+    ;
+  for(p = (const char *)w; p < e && *p; p++)
+    ;
+  return p - s;
+}
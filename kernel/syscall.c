@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "batch.h"
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -101,6 +102,22 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_nice(void);
+extern uint64 sys_sched_setattr(void);
+extern uint64 sys_sched_getattr(void);
+extern uint64 sys_sched_yield(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_getcpu(void);
+extern uint64 sys_groupcreate(void);
+extern uint64 sys_groupjoin(void);
+extern uint64 sys_groupstat(void);
+extern uint64 sys_waitpid(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_batch(void);
+extern uint64 sys_uringsetup(void);
+extern uint64 sys_uringenter(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -126,6 +143,22 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_nice]    sys_nice,
+[SYS_sched_setattr] sys_sched_setattr,
+[SYS_sched_getattr] sys_sched_getattr,
+[SYS_sched_yield]   sys_sched_yield,
+[SYS_nanosleep]     sys_nanosleep,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_getcpu]        sys_getcpu,
+[SYS_groupcreate]   sys_groupcreate,
+[SYS_groupjoin]     sys_groupjoin,
+[SYS_groupstat]     sys_groupstat,
+[SYS_waitpid]       sys_waitpid,
+[SYS_spawn]         sys_spawn,
+[SYS_batch]         sys_batch,
+[SYS_uringsetup]    sys_uringsetup,
+[SYS_uringenter]    sys_uringenter,
 };
 
 void
@@ -134,7 +167,7 @@ syscall(void)
   int num;
   struct proc *p = myproc();
 
-  num = p->trapframe->a7;
+  num = p->trapframe->a7 & ~SYS_SLOW;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
@@ -145,3 +178,68 @@ syscall(void)
     p->trapframe->a0 = -1;
   }
 }
+
+// may batch() run system call num? not fork or exec, which
+// would return to user space in the middle of the batch, nor
+// batch itself.
+static int
+batchable(int num)
+{
+  if(num <= 0 || num >= NELEM(syscalls) || syscalls[num] == 0)
+    return 0;
+  return num != SYS_fork && num != SYS_exec && num != SYS_batch;
+}
+
+// Run the n system calls described by the batchcall array
+// at ucalls, in order, in one trip into the kernel, storing
+// each one's result in its ret. Returns the number of calls
+// run, which is less than n if one with BATCH_STOP failed,
+// or -1 if n is out of range.
+uint64
+sys_batch(void)
+{
+  struct proc *p = myproc();
+  struct trapframe *tf = p->trapframe;
+  struct batchcall c;
+  uint64 ucalls, ret[NBATCH], save[7];
+  int n, i;
+
+  argaddr(0, &ucalls);
+  argint(1, &n);
+  if(n < 0 || n > NBATCH)
+    return -1;
+
+  // the calls fetch their arguments from the trapframe.
+  save[0] = tf->a0; save[1] = tf->a1; save[2] = tf->a2;
+  save[3] = tf->a3; save[4] = tf->a4; save[5] = tf->a5;
+  save[6] = tf->a7;
+
+  for(i = 0; i < n && !killed(p); i++){
+    if(copyin(p->pagetable, (char *)&c, ucalls + i*sizeof(c), sizeof(c)) < 0)
+      break;
+    if((c.flags & BATCH_CHAIN) &&
+       (c.from < 0 || c.from >= i || c.arg < 0 || c.arg >= NELEM(c.args))){
+      c.ret = -1;
+    } else if(!batchable(c.num)){
+      c.ret = -1;
+    } else {
+      if(c.flags & BATCH_CHAIN)
+        c.args[c.arg] = ret[c.from];
+      tf->a0 = c.args[0]; tf->a1 = c.args[1]; tf->a2 = c.args[2];
+      tf->a3 = c.args[3]; tf->a4 = c.args[4]; tf->a5 = c.args[5];
+      tf->a7 = c.num;
+      c.ret = syscalls[c.num]();
+    }
+    ret[i] = c.ret;
+    if(copyout(p->pagetable, ucalls + i*sizeof(c), (char *)&c, sizeof(c)) < 0 ||
+       ((c.flags & BATCH_STOP) && (long)c.ret < 0)){
+      i++;
+      break;
+    }
+  }
+
+  tf->a0 = save[0]; tf->a1 = save[1]; tf->a2 = save[2];
+  tf->a3 = save[3]; tf->a4 = save[4]; tf->a5 = save[5];
+  tf->a7 = save[6];
+  return i;
+}
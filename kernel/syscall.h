@@ -20,3 +20,22 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_nice   22
+#define SYS_sched_setattr 23
+#define SYS_sched_getattr 24
+#define SYS_sched_yield   25
+#define SYS_nanosleep     26
+#define SYS_sched_setaffinity 27
+#define SYS_sched_getaffinity 28
+#define SYS_getcpu        29
+#define SYS_groupcreate   30
+#define SYS_groupjoin     31
+#define SYS_groupstat     32
+#define SYS_waitpid       33
+#define SYS_spawn         34
+#define SYS_batch         35
+#define SYS_uringsetup    36
+#define SYS_uringenter    37
+
+// or'd into a7: skip uservec's fast path, to compare the two.
+#define SYS_SLOW          0x100
@@ -6,6 +6,7 @@
 
 #include "types.h"
 #include "riscv.h"
+#include "memlayout.h"
 #include "defs.h"
 #include "param.h"
 #include "stat.h"
@@ -15,6 +16,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "spawn.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -431,47 +433,74 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Fetch the null-terminated array of argument strings at user
+// address uargv into argv, packing the strings into buf, a
+// page; they couldn't fill more than the user stack anyway.
+// Returns -1 if there are too many, or they don't fit.
+static int
+fetchargv(uint64 uargv, char **argv, char *buf)
 {
-  char path[MAXPATH], *argv[MAXARG];
-  int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
+  int i, n, used = 0;
 
-  argaddr(1, &uargv);
-  if(argstr(0, path, MAXPATH) < 0) {
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
-    }
-    if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
-    }
+    if(i >= MAXARG)
+      return -1;
+    if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0)
+      return -1;
     if(uarg == 0){
       argv[i] = 0;
-      break;
+      return 0;
     }
-    argv[i] = kalloc();
-    if(argv[i] == 0)
-      goto bad;
-    if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+    if((n = fetchstr(uarg, buf+used, PGSIZE-used)) < 0)
+      return -1;
+    argv[i] = buf+used;
+    used += n+1;
   }
+}
 
-  int ret = exec(path, argv);
-
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG], *buf;
+  uint64 uargv;
+  int ret = -1;
 
+  argaddr(1, &uargv);
+  if(argstr(0, path, MAXPATH) < 0) {
+    return -1;
+  }
+  if((buf = kalloc()) == 0)
+    return -1;
+  if(fetchargv(uargv, argv, buf) == 0)
+    ret = exec(path, argv);
+  kfree(buf);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG], *buf;
+  struct spawnact act[NSPAWNACT];
+  uint64 uargv, uact;
+  int nact, ret = -1;
+
+  argaddr(1, &uargv);
+  argaddr(2, &uact);
+  argint(3, &nact);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  if(nact < 0 || nact > NSPAWNACT)
+    return -1;
+  if(nact > 0 && copyin(myproc()->pagetable, (char *)act, uact, nact*sizeof(act[0])) < 0)
+    return -1;
+  if((buf = kalloc()) == 0)
+    return -1;
+  if(fetchargv(uargv, argv, buf) == 0)
+    ret = spawn(path, argv, act, nact);
+  kfree(buf);
+  return ret;
 }
 
 uint64
@@ -503,3 +532,22 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// map the calling process's asynchronous I/O rings,
+// and return their address.
+uint64
+sys_uringsetup(void)
+{
+  if(uringsetup(myproc()) < 0)
+    return -1;
+  return URING;
+}
+
+uint64
+sys_uringenter(void)
+{
+  int min;
+
+  argint(0, &min);
+  return uringenter(myproc(), min);
+}
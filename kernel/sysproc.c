@@ -5,6 +5,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sched.h"
+#include "wait.h"
 
 uint64
 sys_exit(void)
@@ -35,6 +37,20 @@ sys_wait(void)
   return wait(p);
 }
 
+uint64
+sys_waitpid(void)
+{
+  int pid, flags;
+  uint64 p;
+
+  argint(0, &pid);
+  argaddr(1, &p);
+  argint(2, &flags);
+  if(flags & ~WNOHANG)
+    return -1;
+  return waitpid(pid, p, flags);
+}
+
 uint64
 sys_sbrk(void)
 {
@@ -52,22 +68,28 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
   if(n < 0)
     n = 0;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return sleepticks(n);
+}
+
+// sleep for at least the given number of nanoseconds,
+// rounded up to the next microsecond.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns, sec, us;
+
+  argaddr(0, &ns);
+  // whole seconds and the rest, so that the conversion
+  // can't overflow; and no further than timers can reach.
+  sec = ns / 1000000000;
+  us = (ns % 1000000000 + 999) / 1000;
+  if(sec > (1UL << 62) / timebase)
+    sec = (1UL << 62) / timebase;
+  return sleepuntil(r_time() + sec * timebase + us * timebase / 1000000);
 }
 
 uint64
@@ -79,15 +101,136 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
+uint64
+sys_nice(void)
+{
+  int incr;
+
+  argint(0, &incr);
+  return nice(incr);
+}
+
+uint64
+sys_sched_setattr(void)
+{
+  struct sched_attr a;
+  uint64 addr;
+  struct proc *p = myproc();
+
+  argaddr(0, &addr);
+  if(copyin(p->pagetable, (char *)&a, addr, sizeof(a)) < 0)
+    return -1;
+  if(a.runtime < 0 || a.period < 0 || a.deadline < 0)
+    return -1;
+  if(schedsetdl(p, a.runtime, a.period, a.deadline) < 0)
+    return -1;
+  // get onto the right CPU.
+  yield();
+  return 0;
+}
+
+uint64
+sys_sched_getattr(void)
+{
+  struct sched_attr a;
+  uint64 addr;
+  struct proc *p = myproc();
+
+  argaddr(0, &addr);
+  schedgetdl(p, &a);
+  if(copyout(p->pagetable, addr, (char *)&a, sizeof(a)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_sched_yield(void)
+{
+  schedyield();
+  return 0;
+}
+
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid;
+  uint64 mask;
+
+  argint(0, &pid);
+  argaddr(1, &mask);
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+  uint64 addr, mask;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  if(getaffinity(pid, &mask) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char *)&mask, sizeof(mask)) < 0)
+    return -1;
+  return 0;
+}
+
+// which CPU the caller is running on; it may have
+// moved by the time it looks.
+uint64
+sys_getcpu(void)
+{
+  int id;
+
+  push_off();
+  id = cpuid();
+  pop_off();
+  return id;
+}
+
+// make a CPU quota group and move the caller into it.
+uint64
+sys_groupcreate(void)
+{
+  int quota, period;
+
+  argint(0, &quota);
+  argint(1, &period);
+  if(quota <= 0 || period <= 0)
+    return -1;
+  return groupcreate(myproc(), quota, period);
+}
+
+uint64
+sys_groupjoin(void)
+{
+  int gid;
+
+  argint(0, &gid);
+  return groupjoin(myproc(), gid);
+}
+
+uint64
+sys_groupstat(void)
+{
+  struct groupstat st;
+  int gid;
+  uint64 addr;
+
+  argint(0, &gid);
+  argaddr(1, &addr);
+  if(groupstat(gid, &st) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// return how many clock ticks have passed
 // since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return r_time() / TICKTIME;
 }
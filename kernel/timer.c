@@ -0,0 +1,357 @@
+//
+// high-resolution timers.
+//
+// each CPU keeps the timers set on it in a red-black tree
+// ordered by expiry, and programs stimecmp for the earliest,
+// so a CPU takes a timer interrupt only when something is
+// due; there is no periodic tick. the scheduler's clock tick
+// is a timer too, c->slice, which runs only while the CPU has
+// something to run (see scheduler() and schedtick()), so idle
+// harts sleep in wfi until their next real event, or until
+// another hart kicks them.
+//
+// timers that only need clock tick resolution, like sleep()'s,
+// can go on the CPU's timer wheel instead (settimerticks()),
+// where setting and cancelling take constant time. the wheel
+// has WHEELLEVELS levels of WHEELSIZE slots; a slot on level
+// l holds the timers expiring in one span of WHEELSIZE^l
+// ticks, and when the wheel reaches the start of that span,
+// it cascades them down to the levels below. the CPU only
+// takes an interrupt at the ticks where a slot with timers in
+// it expires or cascades.
+//
+// a timer's function runs in the timer interrupt on the CPU
+// the timer was set on, with interrupts off and no locks
+// held. it must not touch the timer, which its owner may
+// free as soon as it has expired.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+static void
+sliceexpire(void *arg)
+{
+  struct cpu *c = arg;
+
+  c->sliceout = 1;
+}
+
+void
+timerqinit(void)
+{
+  for(int i = 0; i < ncpu; i++){
+    initlock(&cpus[i].tlock, "timers");
+    inittimer(&cpus[i].slice, sliceexpire, &cpus[i]);
+  }
+}
+
+void
+inittimer(struct timer *t, void (*fn)(void *), void *arg)
+{
+  t->fn = fn;
+  t->arg = arg;
+  t->cpu = -1;
+}
+
+static int
+timerless(struct rbnode *a, struct rbnode *b)
+{
+  struct timer *s = RBENTRY(a, struct timer, node);
+  struct timer *t = RBENTRY(b, struct timer, node);
+
+  return (long)(s->when - t->when) < 0;
+}
+
+// put t on w's slot for t->when, which must not
+// be before w->now.
+static void
+wheeladd(struct wheel *w, struct timer *t)
+{
+  struct timer **head;
+  uint64 d, k;
+  int l, shift;
+
+  d = t->when - w->now;
+  for(l = 0; l < WHEELLEVELS-1; l++)
+    if(d < (1UL << ((l+1) * WHEELBITS)))
+      break;
+  shift = l * WHEELBITS;
+  k = t->when >> shift;
+  // beyond the top level: come back to it in a while.
+  if(d >= (1UL << (WHEELLEVELS * WHEELBITS)))
+    k = (w->now >> shift) + WHEELSIZE - 1;
+  head = &w->slot[l][k & (WHEELSIZE-1)];
+  t->next = *head;
+  if(t->next)
+    t->next->pprev = &t->next;
+  *head = t;
+  t->pprev = head;
+  if((k << shift) < w->next)
+    w->next = k << shift;
+}
+
+static void
+wheeldel(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+}
+
+// the first tick after w->now at which a slot with timers
+// in it expires or cascades, or ~0 if there is none.
+static uint64
+wheelnext(struct wheel *w)
+{
+  uint64 k, next = ~0UL;
+  int shift;
+
+  for(int l = 0; l < WHEELLEVELS; l++){
+    shift = l * WHEELBITS;
+    for(int i = 1; i <= WHEELSIZE; i++){
+      k = (w->now >> shift) + i;
+      if(w->slot[l][k & (WHEELSIZE-1)]){
+        if((k << shift) < next)
+          next = k << shift;
+        break;
+      }
+    }
+  }
+  return next;
+}
+
+// advance c's wheel to tick, running the timers that expire
+// on the way. c->tlock must be held; it is released while the
+// timers' functions run.
+static void
+wheelrun(struct cpu *c, uint64 tick)
+{
+  struct wheel *w = &c->wheel;
+  struct timer *t, *list;
+  void (*fn)(void *);
+  void *arg;
+  uint64 k;
+  int l, i;
+
+  while(w->now < tick){
+    if(w->n == 0 || w->next > tick){
+      w->now = tick;
+      break;
+    }
+    k = w->now = w->next;
+    for(l = 1; l < WHEELLEVELS; l++){
+      if(k & ((1UL << (l * WHEELBITS)) - 1))
+        break;
+      i = (k >> (l * WHEELBITS)) & (WHEELSIZE-1);
+      list = w->slot[l][i];
+      w->slot[l][i] = 0;
+      while((t = list) != 0){
+        list = t->next;
+        wheeladd(w, t);
+      }
+    }
+    while((t = w->slot[0][k & (WHEELSIZE-1)]) != 0){
+      wheeldel(t);
+      w->n--;
+      t->cpu = -1;
+      fn = t->fn;
+      arg = t->arg;
+      release(&c->tlock);
+      if(fn)
+        fn(arg);
+      acquire(&c->tlock);
+    }
+    w->next = wheelnext(w);
+  }
+}
+
+// ask for a timer interrupt when c's next timer expires, or
+// never. this also clears any pending timer interrupt.
+static void
+program(struct cpu *c)
+{
+  struct rbnode *n = rb_first(&c->timers);
+  uint64 when = ~0UL;
+
+  if(n)
+    when = RBENTRY(n, struct timer, node)->when;
+  if(c->wheel.n > 0 && c->wheel.next * TICKTIME < when)
+    when = c->wheel.next * TICKTIME;
+  w_stimecmp(when);
+}
+
+// Arm t to expire when r_time() reaches when, on this CPU,
+// cancelling any earlier setting. Only one thread at a time
+// may set a given timer.
+void
+settimer(struct timer *t, uint64 when)
+{
+  struct cpu *c;
+
+  canceltimer(t);
+  push_off();
+  c = mycpu();
+  acquire(&c->tlock);
+  t->when = when;
+  t->cpu = c - cpus;
+  t->wheel = 0;
+  rb_insert(&c->timers, &t->node, timerless);
+  if(rb_first(&c->timers) == &t->node)
+    program(c);
+  release(&c->tlock);
+  pop_off();
+}
+
+// Arm t to expire at the start of clock tick tick, counting
+// from boot, on this CPU's timer wheel; see settimer().
+void
+settimerticks(struct timer *t, uint64 tick)
+{
+  struct cpu *c;
+  struct wheel *w;
+
+  canceltimer(t);
+  push_off();
+  c = mycpu();
+  w = &c->wheel;
+  acquire(&c->tlock);
+  if(w->n == 0){
+    // nothing to catch up on.
+    w->now = r_time() / TICKTIME;
+    w->next = ~0UL;
+  }
+  t->when = tick > w->now ? tick : w->now + 1;
+  t->cpu = c - cpus;
+  t->wheel = 1;
+  wheeladd(w, t);
+  w->n++;
+  program(c);
+  release(&c->tlock);
+  pop_off();
+}
+
+// Disarm t. Returns 1 if it hadn't expired yet.
+// Leaves stimecmp alone: an early interrupt is harmless.
+int
+canceltimer(struct timer *t)
+{
+  struct cpu *c;
+  int cpu;
+
+  while((cpu = __atomic_load_n(&t->cpu, __ATOMIC_RELAXED)) >= 0){
+    c = &cpus[cpu];
+    acquire(&c->tlock);
+    if(t->cpu == cpu){
+      if(t->wheel){
+        wheeldel(t);
+        c->wheel.n--;
+      } else {
+        rb_erase(&c->timers, &t->node);
+      }
+      t->cpu = -1;
+      release(&c->tlock);
+      return 1;
+    }
+    release(&c->tlock);
+  }
+  return 0;
+}
+
+// Is t armed? A hint, unless the caller is the one
+// thread that sets t.
+int
+timerpending(struct timer *t)
+{
+  return __atomic_load_n(&t->cpu, __ATOMIC_RELAXED) >= 0;
+}
+
+// Run this CPU's expired timers, and ask for an interrupt
+// when the next one expires, or never.
+// Called from clockintr() with interrupts off.
+void
+timerintr(void)
+{
+  struct cpu *c = mycpu();
+  struct rbnode *n;
+  struct timer *t;
+  void (*fn)(void *);
+  void *arg;
+
+  acquire(&c->tlock);
+  wheelrun(c, r_time() / TICKTIME);
+  while((n = rb_first(&c->timers)) != 0){
+    t = RBENTRY(n, struct timer, node);
+    if((long)(r_time() - t->when) < 0)
+      break;
+    rb_erase(&c->timers, n);
+    t->cpu = -1;
+    fn = t->fn;
+    arg = t->arg;
+    release(&c->tlock);
+    if(fn)
+      fn(arg);
+    acquire(&c->tlock);
+  }
+  program(c);
+  release(&c->tlock);
+}
+
+static void
+timerwakeup(void *chan)
+{
+  acquire(&tickslock);
+  wakeup(chan);
+  release(&tickslock);
+}
+
+// sleep until t, which wakes up its own address, has expired
+// and r_time() has reached when. Returns -1 if the process
+// is killed first.
+static int
+timersleep(struct timer *t, uint64 when)
+{
+  int r = 0;
+
+  acquire(&tickslock);
+  while((long)(r_time() - when) < 0){
+    if(killed(myproc())){
+      r = -1;
+      break;
+    }
+    sleep(t, &tickslock);
+  }
+  release(&tickslock);
+  canceltimer(t);
+  return r;
+}
+
+// Sleep until r_time() reaches when.
+// Returns -1 if the process is killed first.
+int
+sleepuntil(uint64 when)
+{
+  struct timer t;
+
+  inittimer(&t, timerwakeup, &t);
+  settimer(&t, when);
+  return timersleep(&t, when);
+}
+
+// Sleep for n clock ticks, to the start of a tick.
+// Returns -1 if the process is killed first.
+int
+sleepticks(int n)
+{
+  struct timer t;
+  uint64 tick = r_time() / TICKTIME + n;
+
+  inittimer(&t, timerwakeup, &t);
+  settimerticks(&t, tick);
+  return timersleep(&t, tick * TICKTIME);
+}
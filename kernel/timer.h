@@ -0,0 +1,29 @@
+#pragma once
+
+// a timer; see timer.c.
+struct timer {
+  uint64 when;             // r_time(), or clock tick on a wheel, at which it expires
+  void (*fn)(void *);      // called when it expires, if not 0
+  void *arg;
+  int cpu;                 // whose queue it is on, or -1
+  int wheel;               // on the wheel, not in the tree?
+  struct rbnode node;
+  struct timer *next;      // in a wheel slot
+  struct timer **pprev;
+};
+
+#define WHEELBITS   6
+#define WHEELSIZE   (1 << WHEELBITS)
+#define WHEELLEVELS 4
+
+// a hierarchical timer wheel, for timers of clock tick
+// resolution; see timer.c.
+struct wheel {
+  uint64 now;              // Last tick processed
+  uint64 next;             // First tick after now with work to do
+  int n;                   // Timers on the wheel
+  struct timer *slot[WHEELLEVELS][WHEELSIZE];
+};
+
+// r_time() per scheduler clock tick.
+#define TICKTIME (timebase / TICKHZ)
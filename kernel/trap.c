@@ -7,7 +7,6 @@
 #include "defs.h"
 
 struct spinlock tickslock;
-uint ticks;
 
 extern char trampoline[], uservec[], userret[];
 
@@ -20,6 +19,7 @@ void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  timerqinit();
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -27,6 +27,8 @@ void
 trapinithart(void)
 {
   w_stvec((uint64)kernelvec);
+  // let user code read the time CSR, for the vdso page.
+  w_scounteren(r_scounteren() | 2);
 }
 
 //
@@ -65,6 +67,18 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0){
+    // store to a copy-on-write page; now it's writable.
+  } else if(r_scause() == 2 && (r_sstatus() & SSTATUS_FS) == SSTATUS_FS_OFF){
+    // illegal instruction with the FP unit off: most likely the
+    // process's first FP instruction in a while. load its FP
+    // state and retry; if the instruction is really illegal,
+    // it traps again with FS on and ends up below.
+    fploadproc(p);
+  } else if(r_scause() == 2 && (r_sstatus() & SSTATUS_VS) == 0 && hasvec){
+    // likewise for the vector unit.
+    if(vecloadproc(p) < 0)
+      setkilled(p);
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -76,10 +90,13 @@ usertrap(void)
   if(killed(p))
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this timer interrupt ends
+  // the process's quantum, or brings a more urgent one.
+  if(which_dev == 2 && schedtick(p))
     yield();
 
+  intr_off();
+  schedunhandoff();
   usertrapret();
 }
 
@@ -106,6 +123,8 @@ usertrapret(void)
   p->trapframe->kernel_sp = p->kstack + PGSIZE; // process's kernel stack
   p->trapframe->kernel_trap = (uint64)usertrap;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
+  p->trapframe->pid = p->pid;                   // for uservec's fast path
+  p->trapframe->ticktime = TICKTIME;
 
   // set up the registers that trampoline.S's sret will use
   // to get to user space.
@@ -114,6 +133,23 @@ usertrapret(void)
   unsigned long x = r_sstatus();
   x &= ~SSTATUS_SPP; // clear SPP to 0 for user mode
   x |= SSTATUS_SPIE; // enable interrupts in user mode
+
+  // let the process use the FP registers only if they still
+  // hold its state; otherwise its first FP instruction traps
+  // and fploadproc() brings the state in.
+  if(mycpu()->fpproc == p && p->fpcpu == cpuid()){
+    if((x & SSTATUS_FS) != SSTATUS_FS_DIRTY)
+      x = (x & ~SSTATUS_FS) | SSTATUS_FS_CLEAN;
+  } else {
+    x &= ~SSTATUS_FS;
+  }
+  // the same for the vector registers.
+  if(mycpu()->vecproc == p && p->veccpu == cpuid()){
+    if((x & SSTATUS_VS) != SSTATUS_VS_DIRTY)
+      x = (x & ~SSTATUS_VS) | SSTATUS_VS_CLEAN;
+  } else {
+    x &= ~SSTATUS_VS;
+  }
   w_sstatus(x);
 
   // set S Exception Program Counter to the saved user pc.
@@ -150,35 +186,40 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0)
+  // give up the CPU if this timer interrupt ends
+  // the process's quantum, or brings a more urgent one.
+  if(which_dev == 2 && myproc() != 0 && schedtick(myproc()))
     yield();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
+  // but keep sstatus.FS and VS, which describe this CPU's FP and
+  // vector registers, and we may have moved to another CPU.
   w_sepc(sepc);
-  w_sstatus(sstatus);
+  uint64 units = SSTATUS_FS | SSTATUS_VS;
+  w_sstatus((sstatus & ~units) | (r_sstatus() & units));
 }
 
 void
 clockintr()
 {
-  if(cpuid() == 0){
-    acquire(&tickslock);
-    ticks++;
-    wakeup(&ticks);
-    release(&tickslock);
-  }
+  // run the timers that are due, and ask for the next
+  // timer interrupt.
+  timerintr();
+}
 
-  // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+// Raise a software interrupt on CPU c, so that it looks at
+// its run queue. It arrives at machinevec on c, which passes
+// it on as a supervisor software interrupt.
+void
+kickcpu(struct cpu *c)
+{
+  *(volatile uint32 *)KCLINT_MSIP(c - cpus) = 1;
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
+// returns 2 if timer interrupt or kick from another CPU,
 // 1 if other device,
 // 0 if not recognized.
 int
@@ -211,6 +252,11 @@ devintr()
     // timer interrupt.
     clockintr();
     return 2;
+  } else if(scause == 0x8000000000000001L){
+    // software interrupt: another CPU kicked this one.
+    // acknowledge it by clearing the SSIP bit in sip.
+    w_sip(r_sip() & ~2);
+    return 2;
   } else {
     return 0;
   }
@@ -0,0 +1,338 @@
+//
+// asynchronous I/O rings, after Linux's io_uring.
+//
+// uringsetup() maps a page at URING into a process, holding
+// a submission ring, where user code queues requests, and a
+// completion ring, where the kernel posts their results (see
+// uring.h). uringenter() hands new submissions to a pool of
+// kernel worker threads and waits for completions. since
+// there are NIOWORKER workers, one process can have that many
+// disk requests in flight, where read() and write() allow
+// only one.
+//
+// a request holds a reference to its file, and the worker
+// reads and writes the process's memory through its page
+// table, so exit, exec, fork and shrinking sbrk wait for the
+// process's requests to finish first (uringdrain()).
+// uringenter() submits no more requests than the completion
+// ring has room for, so completions never overflow it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+#include "uring.h"
+
+// a request taken from a submission ring.
+struct uringop {
+  struct uringop *next;  // on uringq, or kr->free
+  struct kuring *kr;
+  struct file *f;
+  struct sqe sqe;
+};
+
+// the kernel's side of a process's rings.
+struct kuring {
+  struct spinlock lock;
+  struct proc *p;
+  struct uring *ring;    // the page at URING
+  uint sqhead;           // the kernel's copies of the indexes
+  uint cqtail;           //   that user code only reads
+  int inflight;          // submitted, but not yet completed
+  struct uringop *free;
+  struct uringop ops[URINGSIZE];
+};
+
+// requests waiting for a worker, oldest first.
+struct {
+  struct spinlock lock;
+  struct uringop *head;
+  struct uringop **tail;
+} uringq;
+
+static void uringworker(void *);
+
+void
+uringinit(void)
+{
+  if(sizeof(struct kuring) > PGSIZE || sizeof(struct uring) > PGSIZE)
+    panic("uringinit");
+  initlock(&uringq.lock, "uringq");
+  uringq.tail = &uringq.head;
+  for(int i = 0; i < NIOWORKER; i++)
+    kthread(uringworker, 0, "uring");
+}
+
+// Map p's rings at URING in pagetable, if p has them.
+// Returns 0 on success, -1 if out of memory.
+int
+uringmap(struct proc *p, pagetable_t pagetable)
+{
+  if(p->uring == 0)
+    return 0;
+  return mappages(pagetable, URING, PGSIZE, (uint64)p->uring->ring,
+                  PTE_R | PTE_W | PTE_U);
+}
+
+// Give p a pair of empty rings at URING, unless it has
+// them already. Returns 0, or -1 if out of memory.
+int
+uringsetup(struct proc *p)
+{
+  struct kuring *kr;
+
+  if(p->uring)
+    return 0;
+  if((kr = (struct kuring *)kalloc()) == 0)
+    return -1;
+  memset(kr, 0, PGSIZE);
+  if((kr->ring = (struct uring *)kalloc()) == 0){
+    kfree(kr);
+    return -1;
+  }
+  memset(kr->ring, 0, PGSIZE);
+  initlock(&kr->lock, "uring");
+  kr->p = p;
+  for(int i = 0; i < URINGSIZE; i++){
+    kr->ops[i].kr = kr;
+    kr->ops[i].next = kr->free;
+    kr->free = &kr->ops[i];
+  }
+  p->uring = kr;
+  if(uringmap(p, p->pagetable) < 0){
+    p->uring = 0;
+    kfree(kr->ring);
+    kfree(kr);
+    return -1;
+  }
+  return 0;
+}
+
+// Wait until none of p's requests are in flight.
+void
+uringdrain(struct proc *p)
+{
+  struct kuring *kr = p->uring;
+
+  if(kr == 0)
+    return;
+  acquire(&kr->lock);
+  while(kr->inflight > 0)
+    sleep(kr, &kr->lock);
+  release(&kr->lock);
+}
+
+// Free p's rings, for freeproc(). Nothing may be in flight,
+// and p's page tables must no longer map them.
+void
+uringfree(struct proc *p)
+{
+  if(p->uring == 0)
+    return;
+  kfree(p->uring->ring);
+  kfree(p->uring);
+  p->uring = 0;
+}
+
+// Post op's result on its completion ring, and give op back.
+static void
+uringdone(struct uringop *op, int res)
+{
+  struct kuring *kr = op->kr;
+  struct cqe *cqe;
+
+  if(op->f)
+    fileclose(op->f);
+  op->f = 0;
+
+  acquire(&kr->lock);
+  cqe = &kr->ring->cq[kr->cqtail % URINGSIZE];
+  cqe->data = op->sqe.data;
+  cqe->res = res;
+  // user code must see the entry before the new tail.
+  __sync_synchronize();
+  kr->ring->cqtail = ++kr->cqtail;
+  op->next = kr->free;
+  kr->free = op;
+  kr->inflight--;
+  wakeup(kr);
+  release(&kr->lock);
+}
+
+// Check op's request, in the context of p, the process that
+// submitted it, and take a reference to its file.
+// Returns 0 if the request can go to a worker.
+static int
+uringcheck(struct proc *p, struct uringop *op)
+{
+  struct sqe *s = &op->sqe;
+  struct file *f;
+
+  if(s->off + s->n < s->off)
+    return -1;
+  if(s->fd < 0 || s->fd >= NOFILE || (f = p->ofile[s->fd]) == 0)
+    return -1;
+  if(f->type != FD_INODE)
+    return -1;
+  switch(s->op){
+  case URING_READ:
+    // break copy-on-write sharing now, in p's context, so that
+    // the worker's copyout() only has to write p's own pages.
+    if(!f->readable || uvmcheck(p->pagetable, s->addr, s->n, 1) < 0)
+      return -1;
+    break;
+  case URING_WRITE:
+    if(!f->writable || uvmcheck(p->pagetable, s->addr, s->n, 0) < 0)
+      return -1;
+    break;
+  case URING_FSYNC:
+    break;
+  default:
+    return -1;
+  }
+  op->f = filedup(f);
+  return 0;
+}
+
+// Hand p's new submissions to the workers, as many as the
+// completion ring has room for, then wait until at least min
+// completions are waiting to be consumed, or nothing is in
+// flight. Returns the number of requests submitted, or -1 if
+// p has no rings, its submission ring is garbled, or it is
+// killed while waiting.
+int
+uringenter(struct proc *p, int min)
+{
+  struct kuring *kr = p->uring;
+  struct uring *ring;
+  struct uringop *op;
+  uint tail, used;
+  int n = 0;
+
+  if(kr == 0)
+    return -1;
+  ring = kr->ring;
+  tail = __atomic_load_n(&ring->sqtail, __ATOMIC_ACQUIRE);
+  if(tail - kr->sqhead > URINGSIZE)
+    return -1;
+
+  // only p moves sqhead, so just the completion side
+  // needs the lock.
+  while(kr->sqhead != tail){
+    acquire(&kr->lock);
+    used = kr->cqtail - __atomic_load_n(&ring->cqhead, __ATOMIC_RELAXED);
+    if(used > URINGSIZE || used + kr->inflight >= URINGSIZE){
+      release(&kr->lock);
+      break;
+    }
+    op = kr->free;
+    kr->free = op->next;
+    kr->inflight++;
+    release(&kr->lock);
+
+    op->sqe = ring->sq[kr->sqhead % URINGSIZE];
+    kr->sqhead++;
+    n++;
+    if(uringcheck(p, op) < 0){
+      uringdone(op, -1);
+      continue;
+    }
+    acquire(&uringq.lock);
+    op->next = 0;
+    *uringq.tail = op;
+    uringq.tail = &op->next;
+    wakeupone(&uringq);
+    release(&uringq.lock);
+  }
+  ring->sqhead = kr->sqhead;
+
+  acquire(&kr->lock);
+  while(kr->inflight > 0 &&
+        (int)(kr->cqtail - __atomic_load_n(&ring->cqhead, __ATOMIC_RELAXED)) < min){
+    if(killed(p)){
+      release(&kr->lock);
+      return -1;
+    }
+    sleep(kr, &kr->lock);
+  }
+  release(&kr->lock);
+  return n;
+}
+
+// Run op's request, using buf, a page, to stage the data.
+// Returns the result for its completion: like pread() and
+// pwrite(), the number of bytes moved before any error, or
+// -1 if the error came first.
+static int
+uringrun(struct uringop *op, char *buf)
+{
+  struct sqe *s = &op->sqe;
+  struct inode *ip = op->f->ip;
+  pagetable_t pagetable = op->kr->p->pagetable;
+  // a few blocks per transaction, as in filewrite().
+  uint max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint tot, m;
+  int r;
+
+  switch(s->op){
+  case URING_READ:
+    for(tot = 0; tot < s->n; tot += r){
+      m = s->n - tot < PGSIZE ? s->n - tot : PGSIZE;
+      if((r = preadi(ip, buf, s->off + tot, m)) == 0)
+        break;
+      if(copyout(pagetable, s->addr + tot, buf, r) < 0)
+        return tot > 0 ? tot : -1;
+    }
+    return tot;
+  case URING_WRITE:
+    for(tot = 0; tot < s->n; tot += r){
+      m = s->n - tot < max ? s->n - tot : max;
+      if(copyin(pagetable, buf, s->addr + tot, m) < 0)
+        return tot > 0 ? tot : -1;
+      begin_op();
+      ilock(ip);
+      r = writei(ip, 0, (uint64)buf, s->off + tot, m);
+      iunlock(ip);
+      end_op();
+      if(r != m){
+        // earlier chunks, and whatever writei() managed
+        // of this one, are committed.
+        if(r > 0)
+          tot += r;
+        return tot > 0 ? tot : -1;
+      }
+    }
+    return tot;
+  case URING_FSYNC:
+    log_sync();
+    return 0;
+  }
+  return -1;
+}
+
+static void
+uringworker(void *arg)
+{
+  struct uringop *op;
+  char *buf;
+
+  if((buf = kalloc()) == 0)
+    panic("uringworker");
+  for(;;){
+    acquire(&uringq.lock);
+    while((op = uringq.head) == 0)
+      sleep(&uringq, &uringq.lock);
+    if((uringq.head = op->next) == 0)
+      uringq.tail = &uringq.head;
+    release(&uringq.lock);
+
+    uringdone(op, uringrun(op, buf));
+  }
+}
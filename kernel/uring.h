@@ -0,0 +1,36 @@
+// asynchronous I/O rings, shared between a process and the
+// kernel in the page at URING; see uring.c.
+#define URINGSIZE   64  // entries in each ring; a power of two
+
+#define URING_READ  1   // read n bytes at offset off of fd into addr
+#define URING_WRITE 2   // write n bytes from addr to fd at offset off
+#define URING_FSYNC 3   // wait until completed writes are on disk
+
+// a request, on the submission ring.
+struct sqe {
+  int op;
+  int fd;
+  uint off;
+  uint n;
+  uint64 addr;
+  uint64 data;   // passed through to the completion
+};
+
+// a result, on the completion ring.
+struct cqe {
+  uint64 data;   // the request's data
+  int res;       // bytes read or written, 0 for fsync, or -1
+  int pad;
+};
+
+// the indexes count up forever; index i names entry
+// i % URINGSIZE. user code writes sqtail, cqhead and the
+// sq entries; the kernel writes the rest.
+struct uring {
+  uint sqhead;
+  uint sqtail;
+  uint cqhead;
+  uint cqtail;
+  struct sqe sq[URINGSIZE];
+  struct cqe cq[URINGSIZE];
+};
@@ -0,0 +1,8 @@
+// the read-only page that the kernel maps at VDSO in every
+// process, so that user code can find out the time and its
+// pid without a system call; see user/ulib.c.
+struct vdso {
+  uint64 timebase;  // rdtime ticks per second
+  uint64 ticktime;  // rdtime ticks per clock tick
+  int pid;
+};
@@ -0,0 +1,176 @@
+//
+// RISC-V vector extension (RVV) support.
+//
+// user vector state is switched lazily, like FP state:
+// usertrapret() leaves sstatus.VS off unless this CPU's
+// vector registers still hold the process's state, the
+// first vector instruction traps, and vecloadproc() loads
+// it. sched() saves the registers only when VS is dirty.
+// the vector registers live in a page allocated on first
+// use, so processes that never use vectors pay nothing.
+//
+// the kernel can also use the vector unit for big copies
+// (see vecmemmove()), after saving any live user state.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+int hasvec;   // do the harts have the vector extension?
+
+// copies shorter than this aren't worth the vector setup.
+#define VECMIN 256
+
+// Find out whether the harts have vectors: sstatus.VS is
+// hardwired to zero if they don't. v0-v31 must fit in the
+// one-page save area, so VLEN can be at most 1024 bits.
+void
+vecinit(void)
+{
+  uint64 x = r_sstatus();
+
+  w_sstatus(x | SSTATUS_VS_CLEAN);
+  if((r_sstatus() & SSTATUS_VS) != 0 && r_vlenb() * 32 <= PGSIZE)
+    hasvec = 1;
+  w_sstatus(x & ~SSTATUS_VS);
+  if(hasvec)
+    printf("vector extension: VLEN %ld\n", r_vlenb() * 8);
+}
+
+// Save p's vector registers into p->vecstate if it has
+// changed them since they were loaded; see fpsaveproc().
+// Interrupts must be disabled.
+void
+vecsaveproc(struct proc *p)
+{
+  uint64 x = r_sstatus();
+
+  if((x & SSTATUS_VS) == SSTATUS_VS_DIRTY){
+    vecsave(&p->vecstate);
+    w_sstatus((x & ~SSTATUS_VS) | SSTATUS_VS_CLEAN);
+  }
+}
+
+// p's first vector instruction since it was last scheduled
+// here trapped because sstatus.VS was off. Load its vector
+// state, allocating the save area on first use.
+// Returns -1 if there are no vectors or no memory.
+// Interrupts must be disabled.
+int
+vecloadproc(struct proc *p)
+{
+  struct vecstate *vs = &p->vecstate;
+
+  if(!hasvec)
+    return -1;
+  if(vs->regs == 0){
+    if((vs->regs = kalloc()) == 0)
+      return -1;
+    memset(vs->regs, 0, PGSIZE);
+    vs->vstart = 0;
+    vs->vcsr = 0;
+    vs->vl = 0;
+    vs->vtype = 1L << 63;  // vill, as at reset
+  }
+  w_sstatus((r_sstatus() & ~SSTATUS_VS) | SSTATUS_VS_CLEAN);
+  vecload(vs);
+  w_sstatus((r_sstatus() & ~SSTATUS_VS) | SSTATUS_VS_CLEAN);
+  mycpu()->vecproc = p;
+  p->veccpu = cpuid();
+  return 0;
+}
+
+// Give np a copy of p's vector state, for fork.
+// Returns -1 if out of memory.
+int
+veccopy(struct proc *p, struct proc *np)
+{
+  char *regs;
+
+  if(p->vecstate.regs == 0)
+    return 0;
+  if((regs = kalloc()) == 0)
+    return -1;
+  push_off();
+  vecsaveproc(p);
+  pop_off();
+  np->vecstate = p->vecstate;
+  np->vecstate.regs = regs;
+  memmove(regs, p->vecstate.regs, PGSIZE);
+  return 0;
+}
+
+// Forget p's vector state, for exec and exit.
+void
+vecfree(struct proc *p)
+{
+  push_off();
+  if(mycpu()->vecproc == p){
+    // don't let sched() save the registers.
+    w_sstatus(r_sstatus() & ~SSTATUS_VS);
+    mycpu()->vecproc = 0;
+  }
+  pop_off();
+  p->veccpu = -1;
+  if(p->vecstate.regs)
+    kfree(p->vecstate.regs);
+  p->vecstate.regs = 0;
+}
+
+// Claim this CPU's vector registers for the kernel, saving the
+// state of the process that owns them. Returns 0, with
+// interrupts off, if the caller may use vecmemmove() or
+// vecmemset() until vecend().
+static int
+vecbegin(uint64 n)
+{
+  struct cpu *c;
+
+  if(!hasvec || n < VECMIN)
+    return -1;
+  push_off();
+  c = mycpu();
+  if(c->vecproc){
+    if(c->vecproc == c->proc)
+      vecsaveproc(c->proc);
+    c->vecproc = 0;
+  }
+  w_sstatus((r_sstatus() & ~SSTATUS_VS) | SSTATUS_VS_CLEAN);
+  return 0;
+}
+
+static void
+vecend(void)
+{
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+  pop_off();
+}
+
+// memmove() for non-overlapping buffers, using the vector
+// unit for big copies when there is one.
+void*
+kmemcpy(void *dst, const void *src, uint n)
+{
+  if(vecbegin(n) < 0)
+    return memmove(dst, src, n);
+  vecmemmove(dst, src, n);
+  vecend();
+  return dst;
+}
+
+// memset(), using the vector unit for big fills (such as
+// zeroing pages) when there is one.
+void*
+kmemset(void *dst, int c, uint n)
+{
+  if(vecbegin(n) < 0)
+    return memset(dst, c, n);
+  vecmemset(dst, c, n);
+  vecend();
+  return dst;
+}
@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -15,6 +17,11 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// bytes of virtual address space mapped by one leaf page-table page.
+#define LEAFSPAN (1L << PXSHIFT(1))
+
+static pte_t *walkpde(pagetable_t, uint64, int);
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -33,19 +40,26 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x4000000, PTE_R | PTE_W);
 
+  // CLINT msip registers, for kickcpu().
+  kvmmap(kpgtbl, CLINTVA, CLINT, 0x4000, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
-  kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
+  kvmmap(kpgtbl, (uint64)etext, (uint64)etext, phystop-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
-  
+  // kernel stacks go below it as processes need them (see
+  // kstackalloc()); make their page-table pages now, so that
+  // mapping a stack never needs memory or leaves a page behind.
+  for(uint64 va = KSTACK(NPROC-1); va < TRAMPOLINE; va += LEAFSPAN)
+    if(walk(kpgtbl, va, 1) == 0)
+      panic("kvmmake");
+
   return kpgtbl;
 }
 
@@ -70,6 +84,67 @@ kvminithart()
   sfence_vma();
 }
 
+// Make a process's kernel page table: a top-level page that
+// shares all of the kernel's mappings, except that the first
+// gigabyte comes from the user page table upgtbl, which
+// uvmkshare() has given the kernel's devices. User memory is
+// then visible to the kernel at user addresses (with
+// sstatus.SUM set), and stays in sync without any copying.
+// returns 0 if out of memory.
+pagetable_t
+kvmcreate(pagetable_t upgtbl)
+{
+  pagetable_t kpgtbl;
+
+  if((kpgtbl = (pagetable_t) kalloc()) == 0)
+    return 0;
+  memmove(kpgtbl, kernel_pagetable, PGSIZE);
+  kpgtbl[0] = upgtbl[0];
+  return kpgtbl;
+}
+
+// Point a process's kernel page table at a new user page
+// table, e.g. when exec() commits to a new image.
+void
+kvmswitch(pagetable_t kpgtbl, pagetable_t upgtbl)
+{
+  kpgtbl[0] = upgtbl[0];
+  sfence_vma();
+}
+
+// Copy the kernel's device mappings in the first gigabyte,
+// which all lie above MAXUSER, into the user page table, so
+// that kvmcreate() can use its first level-1 page. The PTEs
+// lack PTE_U, so user code can't touch the devices.
+// returns 0 on success, -1 if out of memory.
+int
+uvmkshare(pagetable_t pagetable)
+{
+  pagetable_t l1, kl1;
+
+  if(walkpde(pagetable, 0, 1) == 0)
+    return -1;
+  l1 = (pagetable_t)PTE2PA(pagetable[0]);
+  kl1 = (pagetable_t)PTE2PA(kernel_pagetable[0]);
+  for(int i = PX(1, MAXUSER); i < 512; i++)
+    l1[i] = kl1[i];
+  return 0;
+}
+
+// Remove the device mappings that uvmkshare() added, since
+// their leaf page-table pages belong to the kernel.
+void
+uvmkunshare(pagetable_t pagetable)
+{
+  pagetable_t l1;
+
+  if((pagetable[0] & PTE_V) == 0)
+    return;
+  l1 = (pagetable_t)PTE2PA(pagetable[0]);
+  for(int i = PX(1, MAXUSER); i < 512; i++)
+    l1[i] = 0;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -102,6 +177,84 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   return &pagetable[PX(0, va)];
 }
 
+// Return the address of the level-1 PTE that points to the
+// leaf page-table page covering va. If alloc!=0, create the
+// level-1 page-table page if it is missing.
+static pte_t *
+walkpde(pagetable_t pagetable, uint64 va, int alloc)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+
+  if(*pte & PTE_V) {
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      return 0;
+    memset(pagetable, 0, PGSIZE);
+    *pte = PA2PTE(pagetable) | PTE_V;
+  }
+  return &pagetable[PX(1, va)];
+}
+
+// Drop a page table's reference to a leaf page-table page
+// that fork may have shared (see uvmcopy()). The last
+// reference also drops the leaf's references to the
+// pages it maps.
+static void
+freeleaf(pagetable_t leaf)
+{
+  if(kputref(leaf) == 0)
+    return;
+  for(int i = 0; i < 512; i++){
+    if(leaf[i] & PTE_V)
+      kfree((void*)PTE2PA(leaf[i]));
+  }
+  kfree((void*)leaf);
+}
+
+// Like walk(), but for callers that are going to change the
+// returned PTE. If the leaf page-table page is still shared
+// with another page table after fork, replace it with a
+// private copy first. Returns 0 if va isn't mapped and
+// alloc==0, or if memory runs out.
+pte_t *
+walkw(pagetable_t pagetable, uint64 va, int alloc)
+{
+  pte_t *pde;
+  pagetable_t leaf, copy;
+
+  if(va >= MAXVA)
+    panic("walkw");
+
+  if((pde = walkpde(pagetable, va, alloc)) == 0)
+    return 0;
+  if((*pde & PTE_V) == 0){
+    if(!alloc || (leaf = (pde_t*)kalloc()) == 0)
+      return 0;
+    memset(leaf, 0, PGSIZE);
+    *pde = PA2PTE(leaf) | PTE_V;
+    return &leaf[PX(0, va)];
+  }
+
+  leaf = (pagetable_t)PTE2PA(*pde);
+  if(kgetref(leaf) > 1){
+    // nobody changes a shared leaf, so it is safe to copy
+    // without a lock. the copy holds its own references
+    // to the pages it maps.
+    if((copy = (pde_t*)kalloc()) == 0)
+      return 0;
+    memmove(copy, leaf, PGSIZE);
+    for(int i = 0; i < 512; i++){
+      if(copy[i] & PTE_V)
+        kincref((void*)PTE2PA(copy[i]));
+    }
+    *pde = PA2PTE(copy) | PTE_V;
+    freeleaf(leaf);
+    leaf = copy;
+  }
+  return &leaf[PX(0, va)];
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -158,7 +311,7 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   a = va;
   last = va + size - PGSIZE;
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
+    if((pte = walkw(pagetable, a, 1)) == 0)
       return -1;
     if(*pte & PTE_V)
       panic("mappages: remap");
@@ -184,7 +337,7 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
+    if((pte = walkw(pagetable, a, 0)) == 0)
       panic("uvmunmap: walk");
     if((*pte & PTE_V) == 0)
       panic("uvmunmap: not mapped");
@@ -237,6 +390,8 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   if(newsz < oldsz)
     return oldsz;
+  if(newsz > MAXUSER)
+    return 0;
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
@@ -245,7 +400,7 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
+    kmemset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -273,10 +428,12 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
   return newsz;
 }
 
-// Recursively free page-table pages.
-// All leaf mappings must already have been removed.
+// Recursively free page-table pages at the given level.
+// Leaf page-table pages are released with freeleaf(), which
+// also frees the user pages they still map once no other
+// page table shares them.
 void
-freewalk(pagetable_t pagetable)
+freewalk(pagetable_t pagetable, int level)
 {
   // there are 2^9 = 512 PTEs in a page table.
   for(int i = 0; i < 512; i++){
@@ -284,7 +441,10 @@ freewalk(pagetable_t pagetable)
     if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
       // this PTE points to a lower-level page table.
       uint64 child = PTE2PA(pte);
-      freewalk((pagetable_t)child);
+      if(level == 1)
+        freeleaf((pagetable_t)child);
+      else
+        freewalk((pagetable_t)child, level - 1);
       pagetable[i] = 0;
     } else if(pte & PTE_V){
       panic("freewalk: leaf");
@@ -293,50 +453,88 @@ freewalk(pagetable_t pagetable)
   kfree((void*)pagetable);
 }
 
-// Free user memory pages,
-// then free page-table pages.
+// Free user memory pages below sz and the page-table pages.
+// The user pages are released together with the leaf
+// page-table pages that map them, so that exiting or
+// exec()ing after fork doesn't have to unshare leaves.
 void
 uvmfree(pagetable_t pagetable, uint64 sz)
 {
-  if(sz > 0)
-    uvmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
-  freewalk(pagetable);
+  freewalk(pagetable, 2);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
-// returns 0 on success, -1 on failure.
-// frees any allocated pages on failure.
+// Given a parent process's page table, make the child's
+// page table share its memory copy-on-write.
+// Rather than copying PTEs, the child's level-1 entries
+// point at the parent's leaf page-table pages, which become
+// shared and reference counted; writable pages in them are
+// marked PTE_COW and read-only. walkw() gives a page table
+// its own copy of a leaf before anything in it changes.
+// returns 0 on success, -1 on failure; the caller's
+// proc_freepagetable() releases whatever was shared.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+{
+  pte_t *pde, *npde;
+  pagetable_t leaf;
+  uint64 va;
+
+  for(va = 0; va < sz; va += LEAFSPAN){
+    if((pde = walkpde(old, va, 0)) == 0 || (*pde & PTE_V) == 0)
+      panic("uvmcopy: pte should exist");
+    leaf = (pagetable_t)PTE2PA(*pde);
+
+    // a leaf that is already shared has no writable PTEs.
+    if(kgetref(leaf) == 1){
+      for(int i = 0; i < 512; i++){
+        if((leaf[i] & PTE_V) && (leaf[i] & PTE_W))
+          leaf[i] = (leaf[i] & ~PTE_W) | PTE_COW;
+      }
+    }
+
+    if((npde = walkpde(new, va, 1)) == 0)
+      return -1;
+    kincref(leaf);
+    *npde = *pde;
+  }
+  return 0;
+}
+
+// Resolve a write to a copy-on-write page at va: give
+// pagetable its own writable copy, or just make the page
+// writable if no one else refers to it anymore.
+// Returns 0 on success, -1 if va isn't a copy-on-write
+// user page or memory runs out.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
-  uint64 pa, i;
+  uint64 pa;
   uint flags;
   char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 ||
+     (*pte & PTE_COW) == 0)
+    return -1;
+  if((pte = walkw(pagetable, va, 0)) == 0)
+    return -1;
+
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(kgetref((void*)pa) > 1){
     if((mem = kalloc()) == 0)
-      goto err;
+      return -1;
     memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
-    }
+    *pte = PA2PTE(mem) | flags;
+    kfree((void*)pa);
+  } else {
+    *pte = PA2PTE(pa) | flags;
   }
   return 0;
-
- err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
-  return -1;
 }
 
 // mark a PTE invalid for user access.
@@ -346,12 +544,66 @@ uvmclear(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   
-  pte = walk(pagetable, va, 0);
+  pte = walkw(pagetable, va, 0);
   if(pte == 0)
     panic("uvmclear");
   *pte &= ~PTE_U;
 }
 
+// Is pagetable the running process's user page table, and so
+// mapped at user addresses by the kernel page table in satp?
+static int
+uvmcurrent(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+  return p != 0 && p->pagetable == pagetable;
+}
+
+// Check that [va, va+len) is user memory in pagetable that
+// the kernel may read or, if write!=0, write, resolving
+// copy-on-write pages along the way. Looks up each leaf
+// page-table page once rather than walking for every page.
+// Return 0 on success, -1 on error.
+int
+uvmcheck(pagetable_t pagetable, uint64 va, uint64 len, int write)
+{
+  uint64 a, last;
+  pte_t *pte = 0;
+  int cow = 0;
+
+  if(len == 0)
+    return 0;
+  if(va >= MAXUSER || len > MAXUSER - va)
+    return -1;
+
+  last = PGROUNDDOWN(va + len - 1);
+  for(a = PGROUNDDOWN(va); ; a += PGSIZE){
+    if(pte == 0 || PX(0, a) == 0){
+      if((pte = walk(pagetable, a, 0)) == 0)
+        return -1;
+    } else {
+      pte++;
+    }
+    if((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+      return -1;
+    if(write && (*pte & PTE_W) == 0){
+      if((*pte & PTE_COW) == 0 || uvmcow(pagetable, a) < 0)
+        return -1;
+      // the leaf page-table page may have been replaced.
+      pte = 0;
+      cow = 1;
+    }
+    if(a == last)
+      break;
+  }
+
+  // the TLB may still hold read-only translations for the
+  // pages that were copy-on-write.
+  if(cow)
+    sfence_vma();
+  return 0;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -359,17 +611,22 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
-  pte_t *pte;
 
+  if(uvmcheck(pagetable, dstva, len, 1) < 0)
+    return -1;
+
+  if(uvmcurrent(pagetable)){
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    kmemcpy((void *)dstva, src, len);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return 0;
+  }
+
+  // not mapped in satp (e.g. exec's new image), so go
+  // through the kernel's direct map of physical memory.
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    if(va0 >= MAXVA)
-      return -1;
-    pte = walk(pagetable, va0, 0);
-    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 ||
-       (*pte & PTE_W) == 0)
-      return -1;
-    pa0 = PTE2PA(*pte);
+    pa0 = walkaddr(pagetable, va0);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -390,11 +647,19 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  if(uvmcheck(pagetable, srcva, len, 0) < 0)
+    return -1;
+
+  if(uvmcurrent(pagetable)){
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    kmemcpy(dst, (void *)srcva, len);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return 0;
+  }
+
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
@@ -414,38 +679,36 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  uint64 n, va0, pa0;
-  int got_null = 0;
+  uint64 n, i, va0;
+  int current = uvmcurrent(pagetable);
+  int got_null;
+  char *src;
 
-  while(got_null == 0 && max > 0){
+  while(max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if(uvmcheck(pagetable, va0, PGSIZE, 0) < 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
 
-    char *p = (char *) (pa0 + (srcva - va0));
-    while(n > 0){
-      if(*p == '\0'){
-        *dst = '\0';
-        got_null = 1;
-        break;
-      } else {
-        *dst = *p;
-      }
-      --n;
-      --max;
-      p++;
-      dst++;
+    if(current){
+      src = (char *)srcva;
+      w_sstatus(r_sstatus() | SSTATUS_SUM);
+    } else {
+      src = (char *)(walkaddr(pagetable, va0) + (srcva - va0));
     }
+    i = strnlen(src, n);
+    got_null = i < n;
+    memmove(dst, src, got_null ? i + 1 : n);
+    if(current)
+      w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    if(got_null)
+      return 0;
 
-    srcva = va0 + PGSIZE;
-  }
-  if(got_null){
-    return 0;
-  } else {
-    return -1;
+    max -= n;
+    dst += n;
+    srcva += n;
   }
+  return -1;
 }
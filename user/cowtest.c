@@ -118,6 +118,84 @@ void threetest()
   printf("ok\n");
 }
 
+// fork repeatedly from a process with a large address space.
+// the children share the parent's leaf page-table pages, so
+// each write has to unshare just the touched leaf without
+// disturbing the parent or the other sharers.
+void pagetabletest()
+{
+  uint64 phys_size = PHYSTOP - KERNBASE;
+  int sz = phys_size / 4;
+  int stride = 2 * 1024 * 1024; // one leaf page-table page
+  int ppid = getpid();
+
+  printf("pagetable: ");
+
+  char* p = sbrk(sz);
+  if (p == (char*)0xffffffffffffffffL) {
+    printf("sbrk(%d) failed\n", sz);
+    exit(-1);
+  }
+
+  for (char* q = p; q < p + sz; q += 4096) {
+    *(int*)q = ppid;
+  }
+
+  for (int i = 0; i < 20; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      printf("fork failed\n");
+      exit(-1);
+    }
+    if (pid == 0) {
+      char* w = p + (i * stride) % sz;
+      *(int*)w = -1;
+
+      int pid2 = fork();
+      if (pid2 < 0) {
+        printf("fork failed\n");
+        exit(-1);
+      }
+      if (pid2 == 0) {
+        if (*(int*)w != -1) {
+          printf("wrong content in grandchild\n");
+          exit(-1);
+        }
+        *(int*)(w + 4096) = -2;
+        exit(0);
+      }
+      wait(0);
+
+      for (char* q = p; q < p + sz; q += 4096) {
+        if (*(int*)q != (q == w ? -1 : ppid)) {
+          printf("wrong content in child\n");
+          exit(-1);
+        }
+      }
+      exit(0);
+    }
+
+    int xstatus;
+    wait(&xstatus);
+    if (xstatus != 0)
+      exit(-1);
+  }
+
+  for (char* q = p; q < p + sz; q += 4096) {
+    if (*(int*)q != getpid()) {
+      printf("wrong content\n");
+      exit(-1);
+    }
+  }
+
+  if (sbrk(-sz) == (char*)0xffffffffffffffffL) {
+    printf("sbrk(-%d) failed\n", sz);
+    exit(-1);
+  }
+
+  printf("ok\n");
+}
+
 char junk1[4096];
 int fds[2];
 char junk2[4096];
@@ -201,6 +279,8 @@ int main(int argc, char* argv[])
 
   filetest();
 
+  pagetabletest();
+
   printf("ALL COW TESTS PASSED\n");
 
   exit(0);
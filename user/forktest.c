@@ -1,11 +1,12 @@
 // Test that fork fails gracefully.
-// Tiny executable so that the limit can be filling the proc table.
+// Tiny executable so that the limit can be the kernel's
+// NPROC kernel stacks rather than memory.
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
 
-#define N  1000
+#define N  5000
 
 void
 print(const char *s)
@@ -0,0 +1,164 @@
+//
+// tests for lazily switched user floating-point state.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NITER (20 * 1000 * 1000)
+
+// a long loop that keeps its accumulators in FP registers,
+// so timer interrupts switch away in the middle of it. all
+// values are small integers, so the result must be exact.
+double
+fploop(int k)
+{
+  double acc = 0, x = k;
+
+  for (int i = 0; i < NITER; i++) {
+    acc += x * (i % 7);
+    x = x * 1.0;
+  }
+  return acc;
+}
+
+long
+intloop(int k)
+{
+  long acc = 0;
+
+  for (int i = 0; i < NITER; i++)
+    acc += (long)k * (i % 7);
+  return acc;
+}
+
+void
+fp_basic(char *s)
+{
+  if (fploop(3) != (double)intloop(3)) {
+    printf("%s: wrong result\n", s);
+    exit(1);
+  }
+}
+
+// several FP-heavy processes at once, each with different
+// values, on fewer harts than processes.
+void
+fp_switch(char *s)
+{
+  int xstatus;
+
+  for (int k = 1; k <= NCHILD; k++) {
+    int pid = fork();
+    if (pid < 0) {
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if (pid == 0) {
+      double a = fploop(k);
+      sleep(1);
+      double b = fploop(k);
+      if (a != b || a != (double)intloop(k)) {
+        printf("%s: child %d: wrong result\n", s, k);
+        exit(1);
+      }
+      exit(0);
+    }
+  }
+
+  for (int k = 1; k <= NCHILD; k++) {
+    wait(&xstatus);
+    if (xstatus != 0)
+      exit(1);
+  }
+}
+
+// fork copies the FP control and status register.
+void
+fp_fork(char *s)
+{
+  int xstatus;
+  uint64 rm;
+
+  asm volatile("fsrm %0" : : "r"(1L)); // round towards zero
+
+  int pid = fork();
+  if (pid < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if (pid == 0) {
+    asm volatile("frrm %0" : "=r"(rm));
+    if (rm != 1) {
+      printf("%s: child rounding mode %d\n", s, (int)rm);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  asm volatile("frrm %0" : "=r"(rm));
+  if (rm != 1) {
+    printf("%s: parent rounding mode %d\n", s, (int)rm);
+    exit(1);
+  }
+  exit(xstatus);
+}
+
+int
+run(void f(char *), char *s) {
+  int pid;
+  int xstatus;
+
+  printf("running test %s\n", s);
+  if((pid = fork()) < 0) {
+    printf("runtest: fork error\n");
+    exit(1);
+  }
+  if(pid == 0) {
+    f(s);
+    exit(0);
+  } else {
+    wait(&xstatus);
+    if(xstatus != 0)
+      printf("test %s: FAILED\n", s);
+    else
+      printf("test %s: OK\n", s);
+    return xstatus == 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *n = 0;
+  if(argc > 1) {
+    n = argv[1];
+  }
+
+  struct test {
+    void (*f)(char *);
+    char *s;
+  } tests[] = {
+    { fp_basic, "fp basic"},
+    { fp_switch, "fp switch"},
+    { fp_fork, "fp fork"},
+    { 0, 0},
+  };
+
+  printf("fptest starting\n");
+
+  int fail = 0;
+  for (struct test *t = tests; t->s != 0; t++) {
+    if((n == 0) || strcmp(t->s, n) == 0) {
+      if(!run(t->f, t->s))
+        fail = 1;
+    }
+  }
+  if(!fail)
+    printf("ALL TESTS PASSED\n");
+  else
+    printf("SOME TESTS FAILED\n");
+  exit(0);
+}
@@ -23,6 +23,9 @@ main(void)
   dup(0);  // stdout
   dup(0);  // stderr
 
+#ifdef BENCH
+  printf("bench: starting sh at %ld us\n", nsuptime() / 1000);
+#endif
   for(;;){
     printf("init: starting sh\n");
     pid = fork();
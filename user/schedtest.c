@@ -0,0 +1,643 @@
+//
+// tests for the scheduler.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+#define NPAIR 3       // pairs of CPU-bound processes
+#define LIGHT 6       // nice 6 gets about a quarter of nice 0's CPU
+#define RUNTICKS 50
+#define NHOG 6        // background CPU hogs
+#define NJOB 15
+#define NSHORT 200    // short sleeps
+#define NPING 1000    // pipe round trips
+#define QUOTA 30000   // group quota, microseconds
+#define PERIOD 100000
+
+// count loops of busy work until uptime() reaches end.
+int
+spin(int end)
+{
+  volatile int x = 0;
+  int n = 0;
+
+  while(uptime() < end){
+    for(int i = 0; i < 100000; i++)
+      x++;
+    n++;
+  }
+  return n;
+}
+
+// pairs of CPU-bound processes, one at nice 0 and one at
+// nice LIGHT, should share the harts about 4 to 1.
+void
+nice_share(char *s)
+{
+  int go[2], res[2];
+  int start, xstatus;
+  int n[2], heavy = 0, light = 0;
+
+  if(pipe(go) < 0 || pipe(res) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 2*NPAIR; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      if(i % 2 && nice(LIGHT) != LIGHT){
+        printf("%s: nice failed\n", s);
+        exit(1);
+      }
+      if(read(go[0], &start, sizeof(start)) != sizeof(start))
+        exit(1);
+      n[0] = i % 2;
+      n[1] = spin(start + RUNTICKS);
+      write(res[1], n, sizeof(n));
+      exit(0);
+    }
+  }
+
+  start = uptime();
+  for(int i = 0; i < 2*NPAIR; i++)
+    write(go[1], &start, sizeof(start));
+  for(int i = 0; i < 2*NPAIR; i++){
+    if(read(res[0], n, sizeof(n)) != sizeof(n)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    if(n[0])
+      light += n[1];
+    else
+      heavy += n[1];
+  }
+  for(int i = 0; i < 2*NPAIR; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+
+  printf("%s: nice 0 %d, nice %d %d\n", s, heavy, LIGHT, light);
+  if(light == 0 || heavy < 2*light || heavy > 8*light){
+    printf("%s: shares not about 4 to 1\n", s);
+    exit(1);
+  }
+}
+
+// nice values are inherited and clamped.
+void
+nice_fork(char *s)
+{
+  int xstatus;
+
+  if(nice(3) != 3 || nice(100) != 19 || nice(-100) != -20 || nice(25) != 5){
+    printf("%s: wrong nice values\n", s);
+    exit(1);
+  }
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(nice(0) == 5 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit nice value\n", s);
+    exit(1);
+  }
+}
+
+// EDF parameters are checked, and admission control turns
+// down more than a CPU's worth of runtime.
+void
+dl_admit(char *s)
+{
+  struct sched_attr a;
+
+  a.runtime = 10000; a.period = 100000; a.deadline = 5000;
+  if(sched_setattr(&a) == 0){
+    printf("%s: accepted runtime > deadline\n", s);
+    exit(1);
+  }
+  a.runtime = 1000000; a.period = 1000000; a.deadline = 1000000;
+  if(sched_setattr(&a) == 0){
+    printf("%s: accepted 100%% of a CPU\n", s);
+    exit(1);
+  }
+  a.runtime = 10000; a.period = 100000; a.deadline = 100000;
+  if(sched_setattr(&a) < 0){
+    printf("%s: refused 10%% of a CPU\n", s);
+    exit(1);
+  }
+  if(sched_getattr(&a) < 0 || a.runtime != 10000 || a.period != 100000){
+    printf("%s: wrong attributes\n", s);
+    exit(1);
+  }
+  a.runtime = a.period = a.deadline = 0;
+  if(sched_setattr(&a) < 0){
+    printf("%s: can't go back to normal\n", s);
+    exit(1);
+  }
+}
+
+// start NHOG CPU hogs; they run until killed.
+void
+hogs(int *pids)
+{
+  for(int i = 0; i < NHOG; i++){
+    if((pids[i] = fork()) < 0){
+      printf("hogs: fork failed\n");
+      exit(1);
+    }
+    if(pids[i] == 0)
+      for(;;)
+        ;
+  }
+}
+
+void
+killhogs(int *pids)
+{
+  for(int i = 0; i < NHOG; i++){
+    kill(pids[i]);
+    wait(0);
+  }
+}
+
+// a periodic EDF process with short jobs misses no deadlines
+// despite the hogs, and sched_yield() waits for the next period.
+void
+dl_periodic(char *s)
+{
+  struct sched_attr a;
+  int pids[NHOG], start, end;
+  volatile int x = 0;
+
+  hogs(pids);
+  a.runtime = 50000; a.period = 300000; a.deadline = 300000;
+  if(sched_setattr(&a) < 0){
+    printf("%s: sched_setattr failed\n", s);
+    exit(1);
+  }
+  start = uptime();
+  for(int i = 0; i < NJOB; i++){
+    for(int j = 0; j < 10000; j++)
+      x++;
+    sched_yield();
+  }
+  end = uptime();
+  sched_getattr(&a);
+  killhogs(pids);
+
+  printf("%s: %d jobs in %d ticks, %d missed\n", s, NJOB, end - start, a.misses);
+  if(a.misses != 0){
+    printf("%s: missed deadlines\n", s);
+    exit(1);
+  }
+  if(end - start < (NJOB - 2) * 3){
+    printf("%s: periods too short\n", s);
+    exit(1);
+  }
+}
+
+// an EDF process that overruns its runtime is throttled, and
+// misses its deadlines: spinning next to a normal process on
+// its CPU, it gets not much more than its runtime/period.
+void
+dl_overrun(char *s)
+{
+  struct sched_attr a;
+  int go[2], res[2], pids[2];
+  int cpu, start, xstatus;
+  int n[3], dl = 0, other = 0, misses = 0;
+
+  if(pipe(go) < 0 || pipe(res) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 2; i++){
+    if(i == 1 && read(res[0], &cpu, sizeof(cpu)) != sizeof(cpu)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    if((pids[i] = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      if(i == 0){
+        // 10% of a CPU.
+        a.runtime = 20000; a.period = 200000; a.deadline = 200000;
+        if(sched_setattr(&a) < 0)
+          exit(1);
+        cpu = getcpu();
+        write(res[1], &cpu, sizeof(cpu));
+      } else if(sched_setaffinity(0, 1L << cpu) < 0){
+        exit(1);
+      }
+      if(read(go[0], &start, sizeof(start)) != sizeof(start))
+        exit(1);
+      n[0] = i;
+      n[1] = spin(start + RUNTICKS / 2);
+      n[2] = 0;
+      if(i == 0 && sched_getattr(&a) == 0)
+        n[2] = a.misses;
+      write(res[1], n, sizeof(n));
+      exit(0);
+    }
+  }
+
+  start = uptime();
+  for(int i = 0; i < 2; i++)
+    write(go[1], &start, sizeof(start));
+  for(int i = 0; i < 2; i++){
+    if(read(res[0], n, sizeof(n)) != sizeof(n)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    if(n[0] == 0){
+      dl = n[1];
+      misses = n[2];
+    } else {
+      other = n[1];
+    }
+  }
+  for(int i = 0; i < 2; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child failed\n", s);
+      exit(1);
+    }
+  }
+
+  printf("%s: EDF %d, normal %d, %d missed\n", s, dl, other, misses);
+  if(misses < 1){
+    printf("%s: no misses\n", s);
+    exit(1);
+  }
+  // runtime/period is 10%; allow twice that.
+  if(dl * 5 > dl + other){
+    printf("%s: overrunner not throttled\n", s);
+    exit(1);
+  }
+}
+
+// nanosleep() sleeps for much less than a clock tick,
+// and sleep() still sleeps for whole ticks.
+void
+hires_sleep(char *s)
+{
+  int start, t;
+
+  start = uptime();
+  for(int i = 0; i < NSHORT; i++){
+    if(nanosleep(1000000) < 0){
+      printf("%s: nanosleep failed\n", s);
+      exit(1);
+    }
+  }
+  t = uptime() - start;
+  printf("%s: %d 1ms sleeps in %d ticks\n", s, NSHORT, t);
+  if(t < 1 || t > NSHORT / 20){
+    printf("%s: wrong duration\n", s);
+    exit(1);
+  }
+  start = uptime();
+  sleep(3);
+  if(uptime() - start < 3){
+    printf("%s: sleep too short\n", s);
+    exit(1);
+  }
+}
+
+// many processes sleeping for different numbers of ticks,
+// including past the end of the timer wheel's first level,
+// each wake up on time.
+void
+many_sleepers(char *s)
+{
+  static int len[] = { 1, 2, 3, 5, 8, 13, 21, 34, 66, 70 };
+  int n = sizeof(len) / sizeof(len[0]);
+  int xstatus, fail = 0;
+
+  for(int i = 0; i < n; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      int start = uptime();
+      sleep(len[i]);
+      int t = uptime() - start;
+      if(t < len[i] || t > len[i] + 2){
+        printf("%s: sleep(%d) took %d ticks\n", s, len[i], t);
+        exit(1);
+      }
+      exit(0);
+    }
+  }
+  for(int i = 0; i < n; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      fail = 1;
+  }
+  exit(fail);
+}
+
+// check that the caller only runs on the CPUs in mask
+// for n ticks, yielding now and then.
+int
+pinned(uint64 mask, int n)
+{
+  int end = uptime() + n;
+
+  while(uptime() < end){
+    if(((mask >> getcpu()) & 1) == 0)
+      return 0;
+    for(volatile int i = 0; i < 100000; i++)
+      ;
+  }
+  return 1;
+}
+
+// processes run only where their affinity masks allow,
+// and children inherit the mask.
+void
+affinity(char *s)
+{
+  uint64 mask, other;
+  int pids[NHOG], xstatus, fail = 0;
+
+  if(sched_setaffinity(0, 0) >= 0){
+    printf("%s: empty mask accepted\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 1 << 1) < 0){
+    printf("%s: only one hart, skipping\n", s);
+    exit(0);
+  }
+  if(sched_getaffinity(0, &mask) < 0 || mask != 1 << 1){
+    printf("%s: sched_getaffinity failed\n", s);
+    exit(1);
+  }
+  if(getcpu() != 1){
+    printf("%s: on cpu %d, not 1\n", s, getcpu());
+    exit(1);
+  }
+
+  // busy children, pinned to cpu 0, stay off cpu 1, and
+  // this process stays on cpu 1 while they run.
+  other = 1 << 0;
+  for(int i = 0; i < NHOG; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      if(sched_getaffinity(0, &mask) < 0 || mask != 1 << 1)
+        exit(2);
+      if(sched_setaffinity(0, other) < 0)
+        exit(3);
+      exit(pinned(other, 10) ? 0 : 1);
+    }
+  }
+  if(!pinned(1 << 1, 10)){
+    printf("%s: parent left cpu 1\n", s);
+    fail = 1;
+  }
+  for(int i = 0; i < NHOG; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child failed with %d\n", s, xstatus);
+      fail = 1;
+    }
+  }
+  exit(fail);
+}
+
+// NPING one-byte round trips between this process and a
+// child over pipes, on harts 0 and 1 if pin is set.
+// Returns the number of ticks they took, or -1 if there is
+// only one hart to pin to.
+int
+pingpong(char *s, int pin)
+{
+  int a[2], b[2], start, t, xstatus;
+  char c = 0;
+
+  if((pin && sched_setaffinity(0, 1 << 0) < 0) || pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(a[1]);
+    close(b[0]);
+    if(pin && sched_setaffinity(0, 1 << 1) < 0)
+      exit(2);  // only one hart
+    for(int i = 0; i < NPING; i++){
+      if(read(a[0], &c, 1) != 1 || write(b[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+  close(a[0]);
+  close(b[1]);
+  start = uptime();
+  for(int i = 0; i < NPING; i++){
+    if(write(a[1], &c, 1) != 1 || read(b[0], &c, 1) != 1){
+      if(i == 0)
+        break;
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+  }
+  t = uptime() - start;
+  close(a[1]);
+  close(b[0]);
+  wait(&xstatus);
+  if(xstatus == 2)
+    return -1;
+  if(xstatus != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  printf("%s: %d round trips in %d ticks\n", s, NPING, t);
+  return t;
+}
+
+// ping-pong between two processes on different harts: each
+// wakeup has to reach a hart that is idle in wfi.
+void
+wake_latency(char *s)
+{
+  int t = pingpong(s, 1);
+
+  if(t < 0){
+    printf("%s: only one hart, skipping\n", s);
+    exit(0);
+  }
+  if(t > NPING / 100){
+    printf("%s: too slow\n", s);
+    exit(1);
+  }
+}
+
+// ping-pong with every hart busy: each side hands the CPU
+// straight to the other instead of queueing behind the hogs.
+void
+pipe_handoff(char *s)
+{
+  int pids[NHOG], t;
+
+  hogs(pids);
+  t = pingpong(s, 0);
+  killhogs(pids);
+  if(t > NPING / 50){
+    printf("%s: too slow\n", s);
+    exit(1);
+  }
+}
+
+// hogs in a group with a 30% quota get about 30% of one CPU
+// between them, and are throttled once each period. only the
+// group's creator may leave it.
+void
+group_quota(char *s)
+{
+  int pids[NHOG], gid, start, t, pid, xstatus;
+  uint64 want;
+  struct groupstat st;
+
+  if(groupcreate(0, PERIOD) >= 0 || groupjoin(-1) >= 0){
+    printf("%s: bad arguments accepted\n", s);
+    exit(1);
+  }
+  if((gid = groupcreate(QUOTA, PERIOD)) < 0){
+    printf("%s: groupcreate failed\n", s);
+    exit(1);
+  }
+  hogs(pids);
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(groupjoin(0) < 0 && groupcreate(QUOTA, PERIOD) < 0 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: a member left the group\n", s);
+    exit(1);
+  }
+  if(groupjoin(0) < 0){
+    printf("%s: can't leave the group\n", s);
+    exit(1);
+  }
+  start = uptime();
+  sleep(20);
+  t = uptime() - start;
+  if(groupstat(gid, &st) < 0){
+    printf("%s: groupstat failed\n", s);
+    exit(1);
+  }
+  killhogs(pids);
+  printf("%s: %d ms used in %d ticks, throttled %d times\n", s,
+         (int)(st.usage / 1000), t, st.throttled);
+  if(st.nproc != NHOG || st.quota != QUOTA || st.period != PERIOD){
+    printf("%s: wrong attributes\n", s);
+    exit(1);
+  }
+  // a tick is 100ms, one period.
+  want = (uint64)t * QUOTA;
+  if(st.usage > want * 3 / 2){
+    printf("%s: quota not enforced\n", s);
+    exit(1);
+  }
+  if(st.usage < want / 2 || st.throttled < t / 2){
+    printf("%s: group starved\n", s);
+    exit(1);
+  }
+  if(groupstat(gid, &st) >= 0){
+    printf("%s: empty group not freed\n", s);
+    exit(1);
+  }
+}
+
+int
+run(void f(char *), char *s) {
+  int pid;
+  int xstatus;
+
+  printf("running test %s\n", s);
+  if((pid = fork()) < 0) {
+    printf("runtest: fork error\n");
+    exit(1);
+  }
+  if(pid == 0) {
+    f(s);
+    exit(0);
+  } else {
+    wait(&xstatus);
+    if(xstatus != 0)
+      printf("test %s: FAILED\n", s);
+    else
+      printf("test %s: OK\n", s);
+    return xstatus == 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *n = 0;
+  if(argc > 1) {
+    n = argv[1];
+  }
+
+  struct test {
+    void (*f)(char *);
+    char *s;
+  } tests[] = {
+    { nice_fork, "nice fork"},
+    { nice_share, "nice share"},
+    { dl_admit, "deadline admit"},
+    { dl_periodic, "deadline periodic"},
+    { dl_overrun, "deadline overrun"},
+    { hires_sleep, "hires sleep"},
+    { many_sleepers, "many sleepers"},
+    { affinity, "affinity"},
+    { wake_latency, "wake latency"},
+    { pipe_handoff, "pipe handoff"},
+    { group_quota, "group quota"},
+    { 0, 0},
+  };
+
+  printf("schedtest starting\n");
+
+  int fail = 0;
+  for (struct test *t = tests; t->s != 0; t++) {
+    if((n == 0) || strcmp(t->s, n) == 0) {
+      if(!run(t->f, t->s))
+        fail = 1;
+    }
+  }
+  if(!fail)
+    printf("ALL TESTS PASSED\n");
+  else
+    printf("SOME TESTS FAILED\n");
+  exit(0);
+}
@@ -3,6 +3,7 @@
 #include "kernel/types.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/wait.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,6 +53,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+int simplecmd(char*, char**);
 void runcmd(struct cmd*) __attribute__((noreturn));
 
 // Execute cmd.  Never returns.
@@ -146,7 +148,8 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  char *argv[MAXARGS];
+  int fd, pid;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -165,6 +168,14 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
+    if(simplecmd(buf, argv)){
+      // no need to copy the shell just to exec.
+      if((pid = spawn(argv[0], argv, 0, 0)) < 0)
+        fprintf(2, "exec %s failed\n", argv[0]);
+      else
+        waitpid(pid, 0, 0);
+      continue;
+    }
     if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(0);
@@ -263,6 +274,37 @@ backcmd(struct cmd *subcmd)
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
 
+// If buf is a command with arguments and nothing else, split
+// it into argv in place and return 1; otherwise leave it be.
+int
+simplecmd(char *buf, char **argv)
+{
+  char *s;
+  int argc = 0;
+
+  for(s = buf; *s; s++){
+    if(strchr(symbols, *s))
+      return 0;
+    if(!strchr(whitespace, *s) && (s == buf || strchr(whitespace, s[-1])))
+      argc++;
+  }
+  if(argc == 0 || argc >= MAXARGS)
+    return 0;
+
+  argc = 0;
+  for(s = buf; *s; ){
+    if(strchr(whitespace, *s)){
+      *s++ = 0;
+      continue;
+    }
+    argv[argc++] = s;
+    while(*s && !strchr(whitespace, *s))
+      s++;
+  }
+  argv[argc] = 0;
+  return 1;
+}
+
 int
 gettoken(char **ps, char *es, char **q, char **eq)
 {
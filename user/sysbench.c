@@ -0,0 +1,366 @@
+//
+// tests and a latency benchmark for the system calls that
+// uservec answers without entering the kernel proper, for
+// the ulib.c functions that read the vdso page instead, and
+// for batch().
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/fcntl.h"
+#include "kernel/syscall.h"
+#include "kernel/batch.h"
+#include "user/user.h"
+
+#define BENCHTICKS 10
+#define BATCH 100     // calls between looks at the clock
+
+// the fast calls give the same answers the kernel would.
+void
+fast_answers(char *s)
+{
+  int fds[2], pid, mypid, start, t;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    mypid = getpid();
+    write(fds[1], &mypid, sizeof(mypid));
+    exit(0);
+  }
+  close(fds[1]);
+  if(read(fds[0], &mypid, sizeof(mypid)) != sizeof(mypid) || mypid != pid){
+    printf("%s: child's getpid() is not fork()'s %d\n", s, pid);
+    exit(1);
+  }
+  close(fds[0]);
+  wait(0);
+
+  start = uptime();
+  sleep(5);
+  t = uptime() - start;
+  if(t < 5 || t > 7){
+    printf("%s: sleep(5) took %d ticks of uptime()\n", s, t);
+    exit(1);
+  }
+
+  if(sched_setaffinity(0, 1) < 0){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 1000; i++){
+    if(getcpu() != 0){
+      printf("%s: getcpu() %d, not 0\n", s, getcpu());
+      exit(1);
+    }
+  }
+}
+
+// the vdso page agrees with the system calls.
+void
+vdso_answers(char *s)
+{
+  int pid, xstatus, start, t;
+  uint64 ns;
+
+  if(ugetpid() != getpid()){
+    printf("%s: ugetpid() %d, getpid() %d\n", s, ugetpid(), getpid());
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(ugetpid() == getpid() ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child's ugetpid() is wrong\n", s);
+    exit(1);
+  }
+
+  t = uptime();
+  if(uuptime() < t || uuptime() > t + 1){
+    printf("%s: uuptime() %d, uptime() %d\n", s, uuptime(), t);
+    exit(1);
+  }
+
+  start = uuptime();
+  ns = nsuptime();
+  sleep(5);
+  t = uuptime() - start;
+  ns = nsuptime() - ns;
+  if(t < 5 || t > 7){
+    printf("%s: sleep(5) took %d ticks of uuptime()\n", s, t);
+    exit(1);
+  }
+  // a tick is 100ms.
+  if(ns < 400000000 || ns > 700000000){
+    printf("%s: sleep(5) took %d ms of nsuptime()\n", s, (int)(ns / 1000000));
+    exit(1);
+  }
+
+  // user code can only read the page.
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile int *)VDSO = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: wrote to the vdso page\n", s);
+    exit(1);
+  }
+}
+
+// batch() runs its calls in order, passes results along,
+// and stops where it is asked to.
+void
+batch_answers(char *s)
+{
+  struct batchcall c[NBATCH+1];
+  struct stat st;
+  char *file = "batchfile";
+  int n;
+
+  // create, write and close, passing the fd along.
+  memset(c, 0, sizeof(c));
+  c[0].num = SYS_open;
+  c[0].flags = BATCH_STOP;
+  c[0].args[0] = (uint64)file;
+  c[0].args[1] = O_CREATE | O_RDWR;
+  c[1].num = SYS_write;
+  c[1].flags = BATCH_CHAIN;
+  c[1].args[1] = (uint64)"hello";
+  c[1].args[2] = 5;
+  c[2].num = SYS_close;
+  c[2].flags = BATCH_CHAIN;
+  if((n = batch(c, 3)) != 3 || (int)c[0].ret < 0 || c[1].ret != 5 || c[2].ret != 0){
+    printf("%s: batch() %d: open %d, write %d, close %d\n",
+           s, n, (int)c[0].ret, (int)c[1].ret, (int)c[2].ret);
+    exit(1);
+  }
+  // stat() is a batch too.
+  if(stat(file, &st) < 0 || st.type != T_FILE || st.size != 5){
+    printf("%s: stat() of %s is wrong\n", s, file);
+    exit(1);
+  }
+
+  // a failure stops the batch only if it asks to.
+  memset(c, 0, sizeof(c));
+  c[0].num = SYS_open;
+  c[0].args[0] = (uint64)"nonexistent";
+  c[1].num = SYS_unlink;
+  c[1].args[0] = (uint64)file;
+  if((n = batch(c, 2)) != 2 || (int)c[0].ret != -1 || c[1].ret != 0){
+    printf("%s: batch() %d: open %d, unlink %d\n",
+           s, n, (int)c[0].ret, (int)c[1].ret);
+    exit(1);
+  }
+  c[0].flags = BATCH_STOP;
+  c[1].ret = 1234;
+  if((n = batch(c, 2)) != 1 || (int)c[0].ret != -1 || c[1].ret != 1234){
+    printf("%s: BATCH_STOP batch() %d\n", s, n);
+    exit(1);
+  }
+
+  // no forks, nested batches, chains to the future, or
+  // oversized batches.
+  memset(c, 0, sizeof(c));
+  c[0].num = SYS_fork;
+  c[1].num = SYS_batch;
+  c[2].num = SYS_getpid;
+  c[2].flags = BATCH_CHAIN;
+  c[2].from = 2;
+  c[3].num = SYS_getpid;
+  if((n = batch(c, 4)) != 4 || (int)c[0].ret != -1 || (int)c[1].ret != -1 ||
+     (int)c[2].ret != -1 || c[3].ret != getpid()){
+    printf("%s: batch() ran a call it shouldn't have\n", s);
+    exit(1);
+  }
+  if(batch(c, NBATCH+1) != -1){
+    printf("%s: batch() of %d calls\n", s, NBATCH+1);
+    exit(1);
+  }
+}
+
+// calls of f() per clock tick.
+int
+rate(int f(int))
+{
+  int n = 0, end;
+
+  // start at the beginning of a tick.
+  end = uptime() + 1;
+  while(uptime() < end)
+    ;
+  end += BENCHTICKS;
+  while(uptime() < end){
+    for(int i = 0; i < BATCH; i++)
+      f(0);
+    n += BATCH;
+  }
+  return n / BENCHTICKS;
+}
+
+int
+dogetpid(int x)
+{
+  return getpid();
+}
+
+int
+douptime(int x)
+{
+  return uptime();
+}
+
+int
+dougetpid(int x)
+{
+  return ugetpid();
+}
+
+int
+douuptime(int x)
+{
+  return uuptime();
+}
+
+int
+doslowgetpid(int x)
+{
+  return slowgetpid();
+}
+
+int
+doslowuptime(int x)
+{
+  return slowuptime();
+}
+
+// nice(0) changes nothing, but takes the whole trap path.
+int
+donice(int x)
+{
+  return nice(x);
+}
+
+// NBATCH calls of nice(0) in one batch().
+int
+dobatch(int x)
+{
+  static struct batchcall c[NBATCH];
+
+  for(int i = 0; i < NBATCH; i++)
+    c[i].num = SYS_nice;
+  return batch(c, NBATCH);
+}
+
+void
+latency(char *s)
+{
+  int fast, clock, slow, slowclock, upid, uclock;
+
+  fast = rate(dogetpid);
+  clock = rate(douptime);
+  slow = rate(doslowgetpid);
+  slowclock = rate(doslowuptime);
+  upid = rate(dougetpid);
+  uclock = rate(douuptime);
+  printf("%s: calls per tick: getpid %d, full path %d\n", s, fast, slow);
+  printf("%s: calls per tick: uptime %d, full path %d\n", s, clock, slowclock);
+  printf("%s: calls per tick: ugetpid %d, uuptime %d\n", s, upid, uclock);
+  if(fast <= slow || clock <= slowclock){
+    printf("%s: fast path not faster\n", s);
+    exit(1);
+  }
+  if(upid <= fast || uclock <= clock){
+    printf("%s: vdso not faster than the fast path\n", s);
+    exit(1);
+  }
+}
+
+void
+batch_latency(char *s)
+{
+  int one, many;
+
+  one = rate(donice);
+  many = rate(dobatch) * NBATCH;
+  printf("%s: calls per tick: nice(0) %d, batched %d\n", s, one, many);
+  if(many <= one){
+    printf("%s: batch() not faster\n", s);
+    exit(1);
+  }
+}
+
+int
+run(void f(char *), char *s) {
+  int pid;
+  int xstatus;
+
+  printf("running test %s\n", s);
+  if((pid = fork()) < 0) {
+    printf("runtest: fork error\n");
+    exit(1);
+  }
+  if(pid == 0) {
+    f(s);
+    exit(0);
+  } else {
+    wait(&xstatus);
+    if(xstatus != 0)
+      printf("test %s: FAILED\n", s);
+    else
+      printf("test %s: OK\n", s);
+    return xstatus == 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *n = 0;
+  if(argc > 1) {
+    n = argv[1];
+  }
+
+  struct test {
+    void (*f)(char *);
+    char *s;
+  } tests[] = {
+    { fast_answers, "fast answers"},
+    { vdso_answers, "vdso answers"},
+    { latency, "latency"},
+    { batch_answers, "batch answers"},
+    { batch_latency, "batch latency"},
+    { 0, 0},
+  };
+
+  printf("sysbench starting\n");
+
+  int fail = 0;
+  for (struct test *t = tests; t->s != 0; t++) {
+    if((n == 0) || strcmp(t->s, n) == 0) {
+      if(!run(t->f, t->s))
+        fail = 1;
+    }
+  }
+  if(!fail)
+    printf("ALL TESTS PASSED\n");
+  else
+    printf("SOME TESTS FAILED\n");
+  exit(0);
+}
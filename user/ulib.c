@@ -1,6 +1,11 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/vdso.h"
+#include "kernel/syscall.h"
+#include "kernel/batch.h"
 #include "user/user.h"
 
 //
@@ -81,18 +86,25 @@ gets(char *buf, int max)
   return buf;
 }
 
+// open, fstat and close, in one batch().
 int
 stat(const char *n, struct stat *st)
 {
-  int fd;
-  int r;
-
-  fd = open(n, O_RDONLY);
-  if(fd < 0)
+  struct batchcall c[3];
+
+  memset(c, 0, sizeof(c));
+  c[0].num = SYS_open;
+  c[0].flags = BATCH_STOP;
+  c[0].args[0] = (uint64)n;
+  c[0].args[1] = O_RDONLY;
+  c[1].num = SYS_fstat;
+  c[1].flags = BATCH_CHAIN;   // the fd from c[0], as args[0]
+  c[1].args[1] = (uint64)st;
+  c[2].num = SYS_close;
+  c[2].flags = BATCH_CHAIN;
+  if(batch(c, 3) != 3)
     return -1;
-  r = fstat(fd, st);
-  close(fd);
-  return r;
+  return c[1].ret;
 }
 
 int
@@ -145,3 +157,41 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+//
+// the time and pid, read from the kernel's vdso page
+// and the time CSR without a system call.
+//
+
+static struct vdso *vdso = (struct vdso *)VDSO;
+
+// the raw timer, which counts vdso->timebase per second.
+uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+int
+ugetpid(void)
+{
+  return vdso->pid;
+}
+
+// like uptime(): clock ticks since boot.
+int
+uuptime(void)
+{
+  return rdtime() / vdso->ticktime;
+}
+
+// nanoseconds since boot.
+uint64
+nsuptime(void)
+{
+  uint64 t = rdtime(), tb = vdso->timebase;
+
+  return t / tb * 1000000000 + t % tb * 1000000000 / tb;
+}
@@ -0,0 +1,368 @@
+//
+// tests for the asynchronous I/O rings, and a benchmark
+// of read throughput against queue depth.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/uring.h"
+#include "user/user.h"
+
+#define NBLK 256     // blocks in the benchmark's file, many more than NBUF
+#define MAXDEPTH 16
+
+struct uring *r;
+
+void
+setup(char *s)
+{
+  if((r = uringsetup()) == (struct uring *)-1){
+    printf("%s: uringsetup failed\n", s);
+    exit(1);
+  }
+}
+
+// queue a request, to be submitted by the next uringenter().
+void
+submit(char *s, int op, int fd, uint off, uint n, void *addr, uint64 data)
+{
+  struct sqe *e;
+  uint tail = r->sqtail;
+
+  if(tail - __atomic_load_n(&r->sqhead, __ATOMIC_ACQUIRE) >= URINGSIZE){
+    printf("%s: submission ring full\n", s);
+    exit(1);
+  }
+  e = &r->sq[tail % URINGSIZE];
+  e->op = op;
+  e->fd = fd;
+  e->off = off;
+  e->n = n;
+  e->addr = (uint64)addr;
+  e->data = data;
+  __atomic_store_n(&r->sqtail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// take the next completion, submitting anything queued and
+// waiting if need be. there must be a request in flight.
+struct cqe
+reap(char *s)
+{
+  struct cqe c;
+
+  while(__atomic_load_n(&r->cqtail, __ATOMIC_ACQUIRE) == r->cqhead){
+    if(uringenter(1) < 0){
+      printf("%s: uringenter failed\n", s);
+      exit(1);
+    }
+  }
+  c = r->cq[r->cqhead % URINGSIZE];
+  __atomic_store_n(&r->cqhead, r->cqhead + 1, __ATOMIC_RELEASE);
+  return c;
+}
+
+// requests run, pass their data through, and fail cleanly.
+void
+rings(char *s)
+{
+  static char buf[4*BSIZE], got[4*BSIZE];
+  struct cqe c;
+  int fd, fds[2], pid, xstatus;
+
+  if(uringenter(0) != -1){
+    printf("%s: uringenter without rings\n", s);
+    exit(1);
+  }
+  setup(s);
+  if(uringsetup() != r){
+    printf("%s: second uringsetup moved the rings\n", s);
+    exit(1);
+  }
+
+  if((fd = open("uringfile", O_CREATE | O_RDWR)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 23;
+
+  // writes one at a time, since there are no holes in files.
+  for(int i = 0; i < 4; i++){
+    submit(s, URING_WRITE, fd, i*BSIZE, BSIZE, buf + i*BSIZE, 100 + i);
+    c = reap(s);
+    if(c.data != 100 + i || c.res != BSIZE){
+      printf("%s: write %d: data %d res %d\n", s, i, (int)c.data, c.res);
+      exit(1);
+    }
+  }
+  submit(s, URING_FSYNC, fd, 0, 0, 0, 200);
+  c = reap(s);
+  if(c.data != 200 || c.res != 0){
+    printf("%s: fsync: data %d res %d\n", s, (int)c.data, c.res);
+    exit(1);
+  }
+
+  // reads all at once, finishing in any order, and one past
+  // the end of the file.
+  for(int i = 0; i < 4; i++)
+    submit(s, URING_READ, fd, i*BSIZE, BSIZE, got + i*BSIZE, 300 + i);
+  submit(s, URING_READ, fd, 4*BSIZE, BSIZE, got, 400);
+  if(uringenter(5) != 5){
+    printf("%s: uringenter didn't submit 5\n", s);
+    exit(1);
+  }
+  if(r->cqtail - r->cqhead != 5){
+    printf("%s: uringenter(5) returned with %d completions\n",
+           s, r->cqtail - r->cqhead);
+    exit(1);
+  }
+  for(int i = 0; i < 5; i++){
+    c = reap(s);
+    if(c.data == 400 ? c.res != 0 : c.res != BSIZE){
+      printf("%s: read %d: res %d\n", s, (int)c.data, c.res);
+      exit(1);
+    }
+  }
+  if(memcmp(buf, got, sizeof(buf)) != 0){
+    printf("%s: read back the wrong data\n", s);
+    exit(1);
+  }
+
+  // bad requests complete with -1.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  submit(s, URING_READ, 99, 0, 1, got, 1);
+  submit(s, URING_READ, fds[0], 0, 1, got, 2);
+  submit(s, 1234, fd, 0, 1, got, 3);
+  submit(s, URING_READ, fd, 0, 1, (void *)0xffffffffff, 4);
+  submit(s, URING_WRITE, fds[1], 0, 1, buf, 5);
+  for(int i = 0; i < 5; i++){
+    c = reap(s);
+    if(c.res != -1){
+      printf("%s: bad request %d: res %d\n", s, (int)c.data, c.res);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // rings aren't inherited.
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(uringenter(0) == -1 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child has its parent's rings\n", s);
+    exit(1);
+  }
+
+  close(fd);
+  unlink("uringfile");
+}
+
+// submissions stop when the completion ring is full.
+void
+full(char *s)
+{
+  char seen[URINGSIZE+1];
+  uint64 data;
+  int fd;
+
+  setup(s);
+  if((fd = open("/", O_RDONLY)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < URINGSIZE; i++)
+    submit(s, URING_FSYNC, fd, 0, 0, 0, i);
+  if(uringenter(URINGSIZE) != URINGSIZE){
+    printf("%s: didn't submit a ring's worth\n", s);
+    exit(1);
+  }
+  submit(s, URING_FSYNC, fd, 0, 0, 0, URINGSIZE);
+  if(uringenter(0) != 0){
+    printf("%s: submitted with the completion ring full\n", s);
+    exit(1);
+  }
+  memset(seen, 0, sizeof(seen));
+  for(int i = 0; i <= URINGSIZE; i++){
+    data = reap(s).data;
+    if(data > URINGSIZE || seen[data]){
+      printf("%s: unexpected completion %d\n", s, (int)data);
+      exit(1);
+    }
+    seen[data] = 1;
+  }
+  close(fd);
+}
+
+// a process can exit with requests in flight.
+void
+exitinflight(char *s)
+{
+  static char buf[MAXDEPTH][BSIZE];
+  int fd, pid, xstatus;
+
+  if((fd = open("README", O_RDONLY)) < 0){
+    printf("%s: open README failed\n", s);
+    exit(1);
+  }
+  for(int n = 0; n < 20; n++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      setup(s);
+      for(int i = 0; i < MAXDEPTH; i++)
+        submit(s, URING_READ, fd, i*BSIZE, BSIZE, buf[i], i);
+      uringenter(0);
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// ns to read the file in blocks, with depth requests in flight.
+uint64
+readfile(char *s, int fd, int depth)
+{
+  static char buf[MAXDEPTH][BSIZE];
+  int idle[MAXDEPTH], nidle = 0;
+  struct cqe c;
+  uint64 start;
+  int next = 0, done = 0, b, slot;
+
+  // requests finish in any order, so keep track of
+  // which buffers are free.
+  for(slot = 0; slot < depth; slot++)
+    idle[nidle++] = slot;
+  start = nsuptime();
+  while(done < NBLK){
+    while(next < NBLK && nidle > 0){
+      slot = idle[--nidle];
+      submit(s, URING_READ, fd, next*BSIZE, BSIZE, buf[slot],
+             (uint64)slot << 32 | next);
+      next++;
+    }
+    c = reap(s);
+    slot = c.data >> 32;
+    b = c.data & 0xffffffff;
+    if(c.res != BSIZE || buf[slot][0] != (char)b){
+      printf("%s: block %d: res %d\n", s, b, c.res);
+      exit(1);
+    }
+    idle[nidle++] = slot;
+    done++;
+  }
+  return nsuptime() - start;
+}
+
+// more requests in flight, more throughput.
+void
+queuedepth(char *s)
+{
+  static char buf[BSIZE];
+  uint64 t1 = 0, t;
+  int fd;
+
+  if((fd = open("uringfile", O_CREATE | O_RDWR)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(int b = 0; b < NBLK; b++){
+    memset(buf, b, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  setup(s);
+
+  // reading the whole file evicts it from the buffer cache.
+  for(int d = 1; d <= MAXDEPTH; d *= 4){
+    t = readfile(s, fd, d);
+    if(d == 1)
+      t1 = t;
+    printf("%s: depth %d: %d KB/s\n", s, d,
+           (int)((uint64)NBLK * BSIZE * 1000000 / (t / 1000 + 1) / 1024));
+  }
+  // on a busy machine the gain may be small, but
+  // going deeper shouldn't make things much worse.
+  if(t > t1 * 3 / 2){
+    printf("%s: deeper queue much slower\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("uringfile");
+}
+
+int
+run(void f(char *), char *s) {
+  int pid;
+  int xstatus;
+
+  printf("running test %s\n", s);
+  if((pid = fork()) < 0) {
+    printf("runtest: fork error\n");
+    exit(1);
+  }
+  if(pid == 0) {
+    f(s);
+    exit(0);
+  } else {
+    wait(&xstatus);
+    if(xstatus != 0)
+      printf("test %s: FAILED\n", s);
+    else
+      printf("test %s: OK\n", s);
+    return xstatus == 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *n = 0;
+  if(argc > 1) {
+    n = argv[1];
+  }
+
+  struct test {
+    void (*f)(char *);
+    char *s;
+  } tests[] = {
+    { rings, "rings"},
+    { full, "full ring"},
+    { exitinflight, "exit in flight"},
+    { queuedepth, "queue depth"},
+    { 0, 0},
+  };
+
+  printf("uringtest starting\n");
+
+  int fail = 0;
+  for (struct test *t = tests; t->s != 0; t++) {
+    if((n == 0) || strcmp(t->s, n) == 0) {
+      if(!run(t->f, t->s))
+        fail = 1;
+    }
+  }
+  if(!fail)
+    printf("ALL TESTS PASSED\n");
+  else
+    printf("SOME TESTS FAILED\n");
+  exit(0);
+}
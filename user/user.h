@@ -1,4 +1,9 @@
 struct stat;
+struct sched_attr;
+struct groupstat;
+struct spawnact;
+struct batchcall;
+struct uring;
 
 // system calls
 int fork(void);
@@ -22,6 +27,24 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int nice(int);
+int sched_setattr(struct sched_attr*);
+int sched_getattr(struct sched_attr*);
+int sched_yield(void);
+int nanosleep(uint64);
+int sched_setaffinity(int, uint64);
+int sched_getaffinity(int, uint64*);
+int getcpu(void);
+int slowgetpid(void);
+int slowuptime(void);
+int groupcreate(int, int);
+int groupjoin(int);
+int groupstat(int, struct groupstat*);
+int waitpid(int, int*, int);
+int spawn(const char*, char**, struct spawnact*, int);
+int batch(struct batchcall*, int);
+struct uring* uringsetup(void);
+int uringenter(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -37,6 +60,10 @@ void* memset(void*, int, uint);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+uint64 rdtime(void);
+int ugetpid(void);
+int uuptime(void);
+uint64 nsuptime(void);
 
 // umalloc.c
 void* malloc(uint);
@@ -4,6 +4,8 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/wait.h"
+#include "kernel/spawn.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -1052,6 +1054,105 @@ reparent2(char *s)
   exit(0);
 }
 
+// waitpid() waits for just the child it names, and
+// WNOHANG doesn't wait at all.
+void
+waitpidtest(char *s)
+{
+  int pid1, pid2, xstate;
+
+  pid1 = fork();
+  if(pid1 < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid1 == 0)
+    exit(1);
+  pid2 = fork();
+  if(pid2 < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid2 == 0){
+    sleep(5);
+    exit(2);
+  }
+
+  if(waitpid(pid2, &xstate, WNOHANG) != 0){
+    printf("%s: WNOHANG reaped a live child\n", s);
+    exit(1);
+  }
+  if(waitpid(pid1, &xstate, 0) != pid1 || xstate != 1){
+    printf("%s: waitpid of first child failed\n", s);
+    exit(1);
+  }
+  if(waitpid(pid1, 0, 0) != -1 || waitpid(getpid(), 0, WNOHANG) != -1){
+    printf("%s: waitpid of a non-child succeeded\n", s);
+    exit(1);
+  }
+  if(waitpid(-1, &xstate, 0) != pid2 || xstate != 2){
+    printf("%s: waitpid of second child failed\n", s);
+    exit(1);
+  }
+  if(waitpid(-1, 0, WNOHANG) != -1){
+    printf("%s: waitpid with no children succeeded\n", s);
+    exit(1);
+  }
+}
+
+// spawn() runs a program with the file actions applied
+// in the child only, and fails cleanly.
+void
+spawntest(char *s)
+{
+  char *argv[] = { "echo", "spawned", 0 };
+  struct spawnact act[3];
+  char buf[32];
+  int fds[2], pid, n, xstate;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  act[0].op = SPAWN_DUP2;
+  act[0].fd = fds[1];
+  act[0].newfd = 1;
+  act[1].op = SPAWN_CLOSE;
+  act[1].fd = fds[0];
+  act[2].op = SPAWN_CLOSE;
+  act[2].fd = fds[1];
+  if((pid = spawn("echo", argv, act, 3)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  n = read(fds[0], buf, sizeof(buf)-1);
+  close(fds[0]);
+  if(waitpid(pid, &xstate, 0) != pid || xstate != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  if(n != 8 || memcmp(buf, "spawned\n", 8) != 0){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+
+  if(spawn("nonexistent", argv, 0, 0) >= 0){
+    printf("%s: spawned a nonexistent program\n", s);
+    exit(1);
+  }
+  act[0].op = SPAWN_CLOSE;
+  act[0].fd = NOFILE;
+  if(spawn("echo", argv, act, 1) >= 0){
+    printf("%s: accepted a bad action\n", s);
+    exit(1);
+  }
+  if(wait(0) != -1){
+    printf("%s: failed spawn left a child\n", s);
+    exit(1);
+  }
+}
+
 // allocate all mem, free it, and allocate again
 void
 mem(char *s)
@@ -1956,13 +2057,15 @@ iref(char *s)
   chdir("/");
 }
 
-// test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// test that fork fails gracefully, and not before there
+// are thousands of processes.
+// the forktest binary also does this, but it may run out of
+// kernel stacks first. inside the bigger usertests binary,
+// we run out of memory first.
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = 5000 };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -1979,7 +2082,12 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
+    exit(1);
+  }
+
+  if(n < 1000){
+    printf("%s: fork failed after %d\n", s, n);
     exit(1);
   }
 
@@ -2617,6 +2725,8 @@ struct test {
   {forkfork, "forkfork"},
   {forkforkfork, "forkforkfork"},
   {reparent2, "reparent2"},
+  {waitpidtest, "waitpid"},
+  {spawntest, "spawn"},
   {mem, "mem"},
   {sharedfd, "sharedfd"},
   {fourfiles, "fourfiles"},
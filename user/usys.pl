@@ -14,6 +14,16 @@ sub entry {
     print " ecall\n";
     print " ret\n";
 }
+
+# the same call, by the full trap path; see SYS_SLOW.
+sub slowentry {
+    my $name = shift;
+    print ".global slow$name\n";
+    print "slow${name}:\n";
+    print " li a7, SYS_${name} | SYS_SLOW\n";
+    print " ecall\n";
+    print " ret\n";
+}
 	
 entry("fork");
 entry("exit");
@@ -36,3 +46,21 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("nice");
+entry("sched_setattr");
+entry("sched_getattr");
+entry("sched_yield");
+entry("nanosleep");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("getcpu");
+entry("groupcreate");
+entry("groupjoin");
+entry("groupstat");
+entry("waitpid");
+entry("spawn");
+entry("batch");
+entry("uringsetup");
+entry("uringenter");
+slowentry("getpid");
+slowentry("uptime");
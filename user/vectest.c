@@ -0,0 +1,211 @@
+//
+// tests for lazily switched user vector (RVV) state.
+// skips everything if the harts don't have vectors.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NITER (5 * 1000 * 1000)
+#define NELEM 4
+
+// v1 = k, v2 = 0, four 32-bit elements each.
+void
+vecset(int k)
+{
+  asm volatile(".option push\n"
+               ".option arch, +v\n"
+               "vsetivli zero, 4, e32, m1, ta, ma\n"
+               "vmv.v.x v1, %0\n"
+               "vmv.v.i v2, 0\n"
+               ".option pop\n" : : "r"(k));
+}
+
+// v2 += v1, n times. relies on vl, vtype, v1 and v2 surviving
+// timer interrupts and system calls.
+void
+vecadd(int n)
+{
+  for (int i = 0; i < n; i++)
+    asm volatile(".option push\n"
+                 ".option arch, +v\n"
+                 "vadd.vv v2, v2, v1\n"
+                 ".option pop\n");
+}
+
+void
+vecget(int *out)
+{
+  asm volatile(".option push\n"
+               ".option arch, +v\n"
+               "vse32.v v2, (%0)\n"
+               ".option pop\n" : : "r"(out) : "memory");
+}
+
+int
+check(char *s, int *v, int want)
+{
+  for (int i = 0; i < NELEM; i++) {
+    if (v[i] != want) {
+      printf("%s: element %d is %d, not %d\n", s, i, v[i], want);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// a vector instruction kills us if there are no vectors.
+int
+hasvec(void)
+{
+  int xstatus;
+
+  int pid = fork();
+  if (pid < 0) {
+    printf("vectest: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    vecset(0);
+    exit(0);
+  }
+  wait(&xstatus);
+  return xstatus == 0;
+}
+
+void
+vec_basic(char *s)
+{
+  int v[NELEM];
+
+  vecset(3);
+  vecadd(1000);
+  vecget(v);
+  if (!check(s, v, 3000))
+    exit(1);
+}
+
+// several vector-heavy processes at once, each with different
+// values, on fewer harts than processes.
+void
+vec_switch(char *s)
+{
+  int xstatus;
+  int v[NELEM];
+
+  for (int k = 1; k <= NCHILD; k++) {
+    int pid = fork();
+    if (pid < 0) {
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if (pid == 0) {
+      vecset(k);
+      vecadd(NITER);
+      sleep(1);
+      vecadd(NITER);
+      vecget(v);
+      if (!check(s, v, 2 * k * NITER))
+        exit(1);
+      exit(0);
+    }
+  }
+
+  for (int k = 1; k <= NCHILD; k++) {
+    wait(&xstatus);
+    if (xstatus != 0)
+      exit(1);
+  }
+}
+
+// fork copies the vector registers.
+void
+vec_fork(char *s)
+{
+  int xstatus;
+  int v[NELEM];
+
+  vecset(7);
+  vecadd(1);
+
+  int pid = fork();
+  if (pid < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if (pid == 0) {
+    vecadd(1);
+    vecget(v);
+    exit(check(s, v, 14) ? 0 : 1);
+  }
+  wait(&xstatus);
+  vecget(v);
+  if (!check(s, v, 7))
+    exit(1);
+  exit(xstatus);
+}
+
+int
+run(void f(char *), char *s) {
+  int pid;
+  int xstatus;
+
+  printf("running test %s\n", s);
+  if((pid = fork()) < 0) {
+    printf("runtest: fork error\n");
+    exit(1);
+  }
+  if(pid == 0) {
+    f(s);
+    exit(0);
+  } else {
+    wait(&xstatus);
+    if(xstatus != 0)
+      printf("test %s: FAILED\n", s);
+    else
+      printf("test %s: OK\n", s);
+    return xstatus == 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *n = 0;
+  if(argc > 1) {
+    n = argv[1];
+  }
+
+  struct test {
+    void (*f)(char *);
+    char *s;
+  } tests[] = {
+    { vec_basic, "vec basic"},
+    { vec_switch, "vec switch"},
+    { vec_fork, "vec fork"},
+    { 0, 0},
+  };
+
+  printf("vectest starting\n");
+
+  if(!hasvec()) {
+    printf("no vector extension, skipping\n");
+    printf("ALL TESTS PASSED\n");
+    exit(0);
+  }
+
+  int fail = 0;
+  for (struct test *t = tests; t->s != 0; t++) {
+    if((n == 0) || strcmp(t->s, n) == 0) {
+      if(!run(t->f, t->s))
+        fail = 1;
+    }
+  }
+  if(!fail)
+    printf("ALL TESTS PASSED\n");
+  else
+    printf("SOME TESTS FAILED\n");
+  exit(0);
+}